@@ -5,6 +5,22 @@
 #include <string>
 #include <SDL2/SDL_image.h>
 #include <vector>
+#include <thread>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <cstring>
+#include <sstream>
+#include "tile_draw_list.h"
+#include "tile_geometry.h"
+#include "level_cache.h"
+#include "native_format.h"
+#include "async_loader.h"
 
 enum KEYVARIANTS {
     KEYBOARD,
@@ -23,6 +39,9 @@ public:
     //Loads image at specified path
     bool loadFromFile(std::string path);
 
+    //Creates texture from a decoded surface, the surface is freed
+    bool loadFromSurface(SDL_Surface* surface);
+
     //Deallocate texture
     void free();
 
@@ -43,6 +62,45 @@ private:
     int mHeight;
 };
 
+class LTileAtlas
+{
+public:
+    //Initializes variables
+    LTileAtlas();
+
+    //Deallocate memory
+    ~LTileAtlas();
+
+    //Packs the images at given paths into one texture, tile indices follow the order of paths
+    bool pack(std::vector<std::string> paths);
+
+    //Deallocate atlas texture
+    void free();
+
+    //Renders a single tile of the atlas
+    void render(int tile, int x, int y, int width, int height);
+
+    //Gets the source rectangle of a tile
+    const SDL_Rect& getClip(int tile) const {return clips[tile];}
+    const std::vector<SDL_Rect>& getClips() const {return clips;}
+
+    //Gets atlas texture and dimensions
+    SDL_Texture* getTexture() const {return mTexture;}
+    int getWidth() const {return mWidth;}
+    int getHeight() const {return mHeight;}
+
+private:
+    //The texture holding every tile
+    SDL_Texture* mTexture;
+
+    //Atlas dimensions
+    int mWidth;
+    int mHeight;
+
+    //Source rectangles of the tiles inside the atlas
+    std::vector<SDL_Rect> clips;
+};
+
 class Player
 {
 public:
@@ -87,27 +145,134 @@ private:
 
 const int SCREEN_WIDTH = 800;
 const int SCREEN_HEIGHT = 800;
+const int ATLAS_MIN_WIDTH = 1024;
+const int ATLAS_PADDING = 1;
 const int JOYSTICK_DEAD_ZONE = 8000;
 
+//Neighbours of a map cell, clockwise from the one above, and the bit each sets in a floor mask
+const int NEIGHBOUR_X[8] = { 0, 1, 1, 1, 0, -1, -1, -1 };
+const int NEIGHBOUR_Y[8] = { -1, -1, 0, 1, 1, 1, 0, -1 };
+enum NEIGHBOURS {
+    FLOOR_N = 1,
+    FLOOR_NE = 2,
+    FLOOR_E = 4,
+    FLOOR_SE = 8,
+    FLOOR_S = 16,
+    FLOOR_SW = 32,
+    FLOOR_W = 64,
+    FLOOR_NW = 128
+};
+
+//Picks the tile drawn for a solid cell from which of its neighbours are floor, following the hand drawn maps:
+//'.' edges have floor above or below, '[' floor to the right, ']' floor to the left,
+//and corners join the two edges they meet whether the floor is on their outside or only on their diagonal
+constexpr char autotileVariant(int floors) {
+    bool n = floors & FLOOR_N;
+    bool e = floors & FLOOR_E;
+    bool s = floors & FLOOR_S;
+    bool w = floors & FLOOR_W;
+    int sides = n + e + s + w;
+    if (sides == 0) {
+        switch (floors) {
+            case FLOOR_SE: return '/';
+            case FLOOR_SW: return '\\';
+            case FLOOR_NE: return ':';
+            case FLOOR_NW: return ';';
+            default: return '#';
+        }
+    }
+    if (sides == 1) {
+        return n || s ? '.' : e ? '[' : ']';
+    }
+    if (sides == 2) {
+        if (n && w) return '/';
+        if (n && e) return '\\';
+        if (s && w) return ':';
+        if (s && e) return ';';
+    }
+    //Walls a single tile thick or sticking out into the floor are filled
+    return '#';
+}
+
+//Every floor mask looked up once, built by the compiler
+struct AutotileTable {
+    char variant[256];
+};
+
+constexpr AutotileTable makeAutotileTable() {
+    AutotileTable table = {};
+    for (int floors = 0; floors < 256; floors++) {
+        table.variant[floors] = autotileVariant(floors);
+    }
+    return table;
+}
+
+constexpr AutotileTable AUTOTILE_TABLE = makeAutotileTable();
+
+const char WINDOW_TITLE[] = "2D camera for two players";
 SDL_Window* gWindow = nullptr;
 LTexture camera_focus_1_texture;
 LTexture camera_focus_2_texture;
 
 std::string levelMap = "";
-std::vector<LTexture> levelTextures;
+LTileAtlas levelAtlas;
 int levelMapWidth = 0;
 int levelMapHeight = 0;
+
+//The draws of row j are levelDrawList[levelDrawRowStart[j]] up to levelDrawList[levelDrawRowStart[j + 1]]
+std::vector<TileDraw> levelDrawList;
+std::vector<int> levelDrawRowStart;
+
+//The quads of levelDrawList against levelAtlas, rebuilt whenever either is loaded
+LTileGeometry levelGeometry;
+
+//Draw calls issued while rendering the current frame, shown in the window title. g switches the map between
+//one geometry batch and one copy per tile
+int gDrawCalls = 0;
+int drawCallsShown = -1;
+bool gUseGeometry = true;
+bool geometryShown = true;
+
+//The tile images of the atlas, the draw list refers to them by their index in this list
+const std::vector<std::string> LEVEL_TILES = {
+    "../level/left_top_corner.png",
+    "../level/top_edge.png",
+    "../level/right_top_corner.png",
+    "../level/left_edge.png",
+    "../level/floor.png",
+    "../level/right_edge.png",
+    "../level/left_bottom_corner.png",
+    "../level/bottom_edge.png",
+    "../level/right_bottom_corner.png",
+
+    "../level/bottom_left_bit.png",
+    "../level/bottom_right_bit.png",
+    "../level/top_left_bit.png",
+    "../level/top_right_bit.png",
+    "../level/wall_fill.png"
+};
+
+//Bump when readLevelMap builds the draw list differently, so caches of the old one are rebuilt
+const Uint32 LEVEL_DRAW_LIST_VERSION = 1;
+
 int map_tile_size = 40;
 
 float camera_x = 0.0f;
 float camera_y = 0.0f;
 
 SDL_Renderer* gRenderer = nullptr;
+SDL_RendererInfo gRendererInfo;
+SDL_Surface* decodeSurface(std::string path);
+LAsyncLoader gLoader(decodeSurface);
 SDL_Joystick* gGameController = NULL;
 
 bool init();
 bool readLevelMap(std::string filename);
+void autotileLevelMap();
 void loadLevelMap();
+int levelTileIndex(char tile);
+void compileLevelDrawList();
+void showDrawCalls();
 void levelMapDisplay(float init_x, float init_y, float single_tile_w, float single_tile_h);
 bool loadMedia();
 void close();
@@ -142,7 +307,7 @@ int main(int argc, char* args[])
             int shared_camera_y = 0;
             int camera_mode = 0;
 
-            readLevelMap("../level_map.txt");
+            readLevelMap(argc > 1 ? args[1] : "../level_map.txt");
             loadLevelMap();
 
             //While application is running
@@ -150,6 +315,7 @@ int main(int argc, char* args[])
             {
                 //Clear screen
                 SDL_RenderClear(gRenderer);
+                gDrawCalls = 0;
 
                 //Handle events on queue
                 while (SDL_PollEvent(&e) != 0)
@@ -178,6 +344,10 @@ int main(int argc, char* args[])
                         camera_mode++;
                         if (camera_mode == 3) {camera_mode = 0;}
                     }
+
+                    if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_g && e.key.repeat == 0) {
+                        gUseGeometry = !gUseGeometry;
+                    }
                 }
 
                 if (SDL_NumJoysticks() > 0) {
@@ -282,6 +452,7 @@ int main(int argc, char* args[])
 
                 //Update screen
                 SDL_RenderPresent(gRenderer);
+                showDrawCalls();
             }
         }
     }
@@ -304,7 +475,7 @@ bool init()
     else
     {
         //Create window
-        gWindow = SDL_CreateWindow("2D camera for two players", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN);
+        gWindow = SDL_CreateWindow(WINDOW_TITLE, SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN);
         if (gWindow == NULL)
         {
             printf("Window could not be created! SDL_Error: %s\n", SDL_GetError());
@@ -324,6 +495,9 @@ bool init()
                 //Initialize renderer color
                 SDL_SetRenderDrawColor(gRenderer, 0x44, 0x81, 0x88, 0xFF);
 
+                //Surfaces are converted to the texture formats this renderer prefers
+                SDL_GetRendererInfo(gRenderer, &gRendererInfo);
+
                 //Initialize PNG loading
                 int imgFlags = IMG_INIT_PNG;
                 if (!(IMG_Init(imgFlags) & imgFlags))
@@ -339,129 +513,173 @@ bool init()
 }
 
 bool readLevelMap(std::string filename) {
-    bool success = true;
-    std::ifstream file;
+    std::ifstream file(filename, std::ios::binary);
     std::string line;
-    file.open(filename);
+    levelMap.clear();
+    levelMapHeight = 0;
+    levelMapWidth = 0;
     if (!file.good()) {
         std::cout << "Wrong file " << filename << std::endl;
-        return !success;
-    }
-    else {
-        levelMap.clear();
-        while (!file.eof()) {
-            levelMapHeight++;
-            std::getline(file, line);
-            levelMap += line;
+        return false;
+    }
+
+    //The draw list built from this same map and tile list on an earlier start is read back instead. The map is
+    //matched by its size and time, its text is only read and hashed when those changed
+    std::string text;
+    bool textRead = false;
+    auto readText = [&]() {
+        if (!textRead) {
+            text.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            textRead = true;
         }
-        levelMapWidth = line.size();
+        return hashBytes(text.data(), text.size());
+    };
+    LevelCacheSource source = levelCacheSource(filename, levelTilesKey(LEVEL_TILES, LEVEL_DRAW_LIST_VERSION));
+    std::string cachePath = filename + ".cache";
+    auto isValid = [](const std::vector<TileDraw>& drawList, const std::vector<int>& rowStart, int width) {
+        return isValidDrawList(drawList, rowStart, width, LEVEL_TILES.size());
+    };
+    if (readLevelCache(cachePath, source, readText, levelDrawList, levelDrawRowStart, levelMapWidth, levelMapHeight, isValid)) {
+        return true;
+    }
+    source.textKey = readText();
+
+    //The width is the longest row, carriage returns and empty lines at the end are ignored
+    std::istringstream lines(text);
+    std::vector<std::string> rows;
+    while (std::getline(lines, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        rows.push_back(line);
+        levelMapWidth = std::max(levelMapWidth, (int)line.size());
+    }
+    while (!rows.empty() && rows.back().empty()) {
+        rows.pop_back();
+    }
+    levelMapHeight = rows.size();
+
+    //Short rows are padded with empty tiles instead of shifting the rows below them
+    for (std::string& row : rows) {
+        row.resize(levelMapWidth, ' ');
+        levelMap += row;
+    }
 
-        file.close();
-        return success;
+    //Maps drawn with nothing but walls and floor get their edges and corners filled in
+    if (levelMap.find_first_not_of("#- ") == std::string::npos) {
+        autotileLevelMap();
     }
+    compileLevelDrawList();
+    writeLevelCache(cachePath, source, levelDrawList, levelDrawRowStart, levelMapWidth, levelMapHeight);
+    return true;
+}
+
+void autotileLevelMap() {
+    //Cells outside the map count as solid, so the border of the map gets its edges too
+    std::string tiles = levelMap;
+    for (int j = 0; j < levelMapHeight; j++) {
+        for (int i = 0; i < levelMapWidth; i++) {
+            if (levelMap[j * levelMapWidth + i] != '#') {
+                continue;
+            }
+            int floors = 0;
+            for (int k = 0; k < 8; k++) {
+                int x = i + NEIGHBOUR_X[k];
+                int y = j + NEIGHBOUR_Y[k];
+                if (x >= 0 && x < levelMapWidth && y >= 0 && y < levelMapHeight && levelMap[y * levelMapWidth + x] == '-') {
+                    floors |= 1 << k;
+                }
+            }
+            tiles[j * levelMapWidth + i] = AUTOTILE_TABLE.variant[floors];
+        }
+    }
+    levelMap.swap(tiles);
 }
 
 void loadLevelMap() {
-    levelTextures.resize(14);
-    levelTextures[0].loadFromFile("../level/left_top_corner.png");
-    levelTextures[1].loadFromFile("../level/top_edge.png");
-    levelTextures[2].loadFromFile("../level/right_top_corner.png");
-    levelTextures[3].loadFromFile("../level/left_edge.png");
-    levelTextures[4].loadFromFile("../level/floor.png");
-    levelTextures[5].loadFromFile("../level/right_edge.png");
-    levelTextures[6].loadFromFile("../level/left_bottom_corner.png");
-    levelTextures[7].loadFromFile("../level/bottom_edge.png");
-    levelTextures[8].loadFromFile("../level/right_bottom_corner.png");
-
-    levelTextures[9].loadFromFile( "../level/bottom_left_bit.png");
-    levelTextures[10].loadFromFile("../level/bottom_right_bit.png");
-    levelTextures[11].loadFromFile("../level/top_left_bit.png");
-    levelTextures[12].loadFromFile("../level/top_right_bit.png");
-    levelTextures[13].loadFromFile("../level/wall_fill.png");
+    //Tile indices used by levelMapDisplay follow the order of LEVEL_TILES
+    levelAtlas.pack(LEVEL_TILES);
+    levelGeometry.build(levelDrawList, levelAtlas.getClips(), levelAtlas.getWidth(), levelAtlas.getHeight());
 }
 
-void levelMapDisplay(float init_x, float init_y, float single_tile_w, float single_tile_h) {
-    LTexture texture;
-    int y = 0;
+int levelTileIndex(char tile) {
+    //Tile indices follow the order of the atlas packed in loadLevelMap, -1 for tiles that aren't drawn
+    switch (tile)
+    {
+        case '/': return 0;
+        case '.': return 1;
+        case '\\': return 2;
+        case '[': return 3;
+        case '-': return 4;
+        case ']': return 5;
+        case ':': return 6;
+        case '_': return 7;
+        case ';': return 8;
+        case 'L': return 9;
+        case 'J': return 10;
+        case '\'': return 11;
+        case '+': return 12;
+        case '#': return 13;
+        default: return -1;
+    }
+}
+
+void compileLevelDrawList() {
+    //The map is decoded once here, drawing only replays the list
+    levelDrawList.clear();
+    levelDrawRowStart.assign(1, 0);
     for (int j = 0; j < levelMapHeight; j++) {
         for (int i = 0; i < levelMapWidth; i++) {
-            switch (levelMap[j * levelMapWidth + i])
-            {
-                case '/':
-                    levelTextures[0].render2(i * single_tile_w + init_x, y * single_tile_h + init_y, single_tile_w,
-                                             single_tile_h);
-                    break;
-                case '.':
-                    levelTextures[1].render2(i * single_tile_w + init_x, y * single_tile_h + init_y, single_tile_w,
-                                             single_tile_h);
-                    break;
-                case '\\':
-                    levelTextures[2].render2(i * single_tile_w + init_x, y * single_tile_h + init_y, single_tile_w,
-                                             single_tile_h);
-                    break;
-                case '[':
-                    levelTextures[3].render2(i * single_tile_w + init_x, y * single_tile_h + init_y, single_tile_w,
-                                             single_tile_h);
-                    break;
-                case '-':
-                    levelTextures[4].render2(i * single_tile_w + init_x, y * single_tile_h + init_y, single_tile_w,
-                                             single_tile_h);
-                    break;
-                case ']':
-                    levelTextures[5].render2(i * single_tile_w + init_x, y * single_tile_h + init_y, single_tile_w,
-                                             single_tile_h);
-                    break;
-                case ':':
-                    levelTextures[6].render2(i * single_tile_w + init_x, y * single_tile_h + init_y, single_tile_w,
-                                             single_tile_h);
-                    break;
-                case '_':
-                    levelTextures[7].render2(i * single_tile_w + init_x, y * single_tile_h + init_y, single_tile_w,
-                                             single_tile_h);
-                    break;
-                case ';':
-                    levelTextures[8].render2(i * single_tile_w + init_x, y * single_tile_h + init_y, single_tile_w,
-                                             single_tile_h);
-                    break;
-                case 'L':
-                    levelTextures[9].render2(i * single_tile_w + init_x, y * single_tile_h + init_y, single_tile_w,
-                                             single_tile_h);
-                    break;
-                case 'J':
-                    levelTextures[10].render2(i * single_tile_w + init_x, y * single_tile_h + init_y, single_tile_w,
-                                              single_tile_h);
-                    break;
-                case '\'':
-                    levelTextures[11].render2(i * single_tile_w + init_x, y * single_tile_h + init_y, single_tile_w,
-                                              single_tile_h);
-                    break;
-                case '+':
-                    levelTextures[12].render2(i * single_tile_w + init_x, y * single_tile_h + init_y, single_tile_w,
-                                              single_tile_h);
-                    break;
-                case '#':
-                    levelTextures[13].render2(i * single_tile_w + init_x, y * single_tile_h + init_y, single_tile_w,
-                                              single_tile_h);
-                    break;
-                default:
-                    std::cout << std::endl;
-                    break;
+            int tile = levelTileIndex(levelMap[j * levelMapWidth + i]);
+            if (tile >= 0) {
+                levelDrawList.push_back({ tile, i, j });
             }
         }
-        y++;
+        levelDrawRowStart.push_back(levelDrawList.size());
     }
 }
 
+void levelMapDisplay(float init_x, float init_y, float single_tile_w, float single_tile_h) {
+    //The tiles on screen go out in one batch where the renderer can draw geometry
+    if (gUseGeometry && levelGeometry.render(gRenderer, levelAtlas.getTexture(), levelDrawList, levelDrawRowStart, init_x, init_y,
+                                             single_tile_w, single_tile_h, 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, gDrawCalls)) {
+        return;
+    }
+
+    //Only the tiles on screen and a tile around it are replayed, however big the map is
+    forEachVisibleTile(levelDrawList, levelDrawRowStart, init_x, init_y, single_tile_w, single_tile_h, SCREEN_WIDTH, SCREEN_HEIGHT,
+                       [single_tile_w, single_tile_h](const TileDraw& draw, float x, float y) {
+                           levelAtlas.render(draw.tile, x, y, single_tile_w, single_tile_h);
+                       });
+}
+
+void showDrawCalls() {
+    //The title only changes with the numbers, setting it every frame would cost more than the draws
+    if (gDrawCalls == drawCallsShown && gUseGeometry == geometryShown) {
+        return;
+    }
+    char title[128];
+    snprintf(title, sizeof(title), "%s - draw calls: %d (%s)", WINDOW_TITLE, gDrawCalls, gUseGeometry ? "geometry" : "copies");
+    SDL_SetWindowTitle(gWindow, title);
+    drawCallsShown = gDrawCalls;
+    geometryShown = gUseGeometry;
+}
+
 bool loadMedia()
 {
     //Loading success flag
     bool success = true;
-    if (!camera_focus_1_texture.loadFromFile("../camerafocus1.png")) {
+
+    //Decode both images on the worker pool, only the uploads run on this thread
+    std::future<SDL_Surface*> cameraFocus1 = gLoader.loadSurface("../camerafocus1.png");
+    std::future<SDL_Surface*> cameraFocus2 = gLoader.loadSurface("../camerafocus2.png");
+
+    if (!camera_focus_1_texture.loadFromSurface(cameraFocus1.get())) {
         printf("Failed to load camerafocus1 texture image!\n");
         success = false;
     }
 
-    if (!camera_focus_2_texture.loadFromFile("../camerafocus2.png")) {
+    if (!camera_focus_2_texture.loadFromSurface(cameraFocus2.get())) {
         printf("Failed to load camerafocus2 texture image!\n");
         success = false;
     }
@@ -471,6 +689,9 @@ bool loadMedia()
 
 void close()
 {
+    //Join the loader workers
+    gLoader.stop();
+
     //Free loaded images
     camera_focus_1_texture.free();
 
@@ -478,6 +699,8 @@ void close()
     SDL_JoystickClose( gGameController );
     gGameController = NULL;
 
+    levelAtlas.free();
+
     //Destroy window
     SDL_DestroyRenderer(gRenderer);
     SDL_DestroyWindow(gWindow);
@@ -489,6 +712,12 @@ void close()
     SDL_Quit();
 }
 
+SDL_Surface* decodeSurface(std::string path)
+{
+    //Load image at specified path
+    return convertToNativeFormat(loadKeyedSurface(SDL_RWFromFile(path.c_str(), "rb"), path), gRendererInfo);
+}
+
 LTexture::LTexture()
 {
     //Initialize
@@ -504,43 +733,36 @@ LTexture::~LTexture()
 }
 
 bool LTexture::loadFromFile(std::string path)
+{
+    //Decode, color key and convert the image, then upload it
+    return loadFromSurface(decodeSurface(path));
+}
+
+bool LTexture::loadFromSurface(SDL_Surface* surface)
 {
     //Get rid of preexisting texture
     free();
 
-    //The final texture
-    SDL_Texture* newTexture = nullptr;
+    if (surface == nullptr)
+    {
+        return false;
+    }
 
-    //Load image at specified path
-    SDL_Surface* loadedSurface = IMG_Load(path.c_str());
-    if (loadedSurface == nullptr)
+    //Create texture from surface pixels
+    mTexture = SDL_CreateTextureFromSurface(gRenderer, surface);
+    if (mTexture == NULL)
     {
-        printf("Unable to load image %s! SDL_image Error: %s\n", path.c_str(), IMG_GetError());
+        printf("Unable to create texture from surface! SDL Error: %s\n", SDL_GetError());
     }
     else
     {
-        //Color key image
-        SDL_SetColorKey(loadedSurface, SDL_TRUE, SDL_MapRGB(loadedSurface->format, 0xFF, 0x11, 0x17));
-
-        //Create texture from surface pixels
-        newTexture = SDL_CreateTextureFromSurface(gRenderer, loadedSurface);
-        if (newTexture == NULL)
-        {
-            printf("Unable to create texture from %s! SDL Error: %s\n", path.c_str(), SDL_GetError());
-        }
-        else
-        {
-            //Get image dimensions
-            mWidth = loadedSurface->w;
-            mHeight = loadedSurface->h;
-        }
-
-        //Get rid of old loaded surface
-        SDL_FreeSurface(loadedSurface);
+        //Get image dimensions
+        mWidth = surface->w;
+        mHeight = surface->h;
     }
 
-    //Return success
-    mTexture = newTexture;
+    //Get rid of the decoded surface
+    SDL_FreeSurface(surface);
     return mTexture != NULL;
 }
 
@@ -561,6 +783,7 @@ void LTexture::render1(int x, int y)
     //Set rendering space and render1 to screen
     SDL_Rect renderQuad = { x, y, mWidth, mHeight };
     SDL_RenderCopy(gRenderer, mTexture, NULL, &renderQuad);
+    gDrawCalls++;
 }
 
 void LTexture::render2(int x, int y, int width, int height)
@@ -568,6 +791,7 @@ void LTexture::render2(int x, int y, int width, int height)
     //Set rendering space and render1 to screen
     SDL_Rect renderQuad = { x, y, width, height };
     SDL_RenderCopy(gRenderer, mTexture, NULL, &renderQuad);
+    gDrawCalls++;
 }
 
 int LTexture::getWidth() const {
@@ -578,6 +802,138 @@ int LTexture::getHeight() const {
     return mHeight;
 }
 
+LTileAtlas::LTileAtlas()
+{
+    //Initialize
+    mTexture = NULL;
+    mWidth = 0;
+    mHeight = 0;
+}
+
+LTileAtlas::~LTileAtlas()
+{
+    //Deallocate
+    free();
+}
+
+bool LTileAtlas::pack(std::vector<std::string> paths)
+{
+    //Get rid of preexisting atlas
+    free();
+
+    bool success = true;
+    int atlasWidth = ATLAS_MIN_WIDTH;
+    std::vector<SDL_Surface*> surfaces(paths.size(), nullptr);
+    std::vector<int> order;
+
+    //Decode every image on the worker pool, decodeSurface already applies the color key
+    std::vector<std::future<SDL_Surface*>> decoded;
+    for (int i = 0; i < paths.size(); i++)
+    {
+        decoded.push_back(gLoader.loadSurface(paths[i]));
+    }
+
+    for (int i = 0; i < paths.size(); i++)
+    {
+        surfaces[i] = decoded[i].get();
+        if (surfaces[i] == nullptr)
+        {
+            success = false;
+            continue;
+        }
+
+        //Keyed pixels are skipped by the blit and stay transparent in the atlas
+        SDL_SetSurfaceBlendMode(surfaces[i], SDL_BLENDMODE_NONE);
+
+        atlasWidth = std::max(atlasWidth, surfaces[i]->w + 2 * ATLAS_PADDING);
+        order.push_back(i);
+    }
+
+    //Shelf packing: tallest images first, a new shelf starts when the current one is full
+    std::sort(order.begin(), order.end(), [&surfaces](int a, int b) { return surfaces[a]->h > surfaces[b]->h; });
+    clips.assign(paths.size(), SDL_Rect{0, 0, 0, 0});
+    int shelfX = 0;
+    int shelfY = 0;
+    int shelfHeight = 0;
+    for (int i : order)
+    {
+        int w = surfaces[i]->w + 2 * ATLAS_PADDING;
+        int h = surfaces[i]->h + 2 * ATLAS_PADDING;
+        if (shelfX + w > atlasWidth)
+        {
+            shelfX = 0;
+            shelfY += shelfHeight;
+            shelfHeight = 0;
+        }
+        clips[i] = { shelfX + ATLAS_PADDING, shelfY + ATLAS_PADDING, surfaces[i]->w, surfaces[i]->h };
+        shelfX += w;
+        shelfHeight = std::max(shelfHeight, h);
+    }
+
+    //Copy every tile into a single transparent surface
+    if (!order.empty())
+    {
+        SDL_Surface* atlasSurface = SDL_CreateRGBSurfaceWithFormat(0, atlasWidth, shelfY + shelfHeight, 32, SDL_PIXELFORMAT_RGBA32);
+        if (atlasSurface == nullptr)
+        {
+            printf("Unable to create atlas surface! SDL Error: %s\n", SDL_GetError());
+            success = false;
+        }
+        else
+        {
+            for (int i : order)
+            {
+                SDL_Rect destination = clips[i];
+                SDL_BlitSurface(surfaces[i], NULL, atlasSurface, &destination);
+            }
+
+            //Create texture from surface pixels
+            atlasSurface = convertToNativeFormat(atlasSurface, gRendererInfo);
+            mTexture = SDL_CreateTextureFromSurface(gRenderer, atlasSurface);
+            if (mTexture == NULL)
+            {
+                printf("Unable to create atlas texture! SDL Error: %s\n", SDL_GetError());
+                success = false;
+            }
+            else
+            {
+                mWidth = atlasSurface->w;
+                mHeight = atlasSurface->h;
+            }
+            SDL_FreeSurface(atlasSurface);
+        }
+    }
+
+    //Get rid of loaded surfaces
+    for (SDL_Surface* surface : surfaces)
+    {
+        SDL_FreeSurface(surface);
+    }
+
+    return success;
+}
+
+void LTileAtlas::free()
+{
+    //Free texture if it exists
+    if (mTexture != NULL)
+    {
+        SDL_DestroyTexture(mTexture);
+        mTexture = NULL;
+        mWidth = 0;
+        mHeight = 0;
+    }
+    clips.clear();
+}
+
+void LTileAtlas::render(int tile, int x, int y, int width, int height)
+{
+    //Set rendering space and render the tile's part of the atlas to screen
+    SDL_Rect renderQuad = { x, y, width, height };
+    SDL_RenderCopy(gRenderer, mTexture, &clips[tile], &renderQuad);
+    gDrawCalls++;
+}
+
 Player::Player(std::string tex, KEYVARIANTS keyVar)
 {
     keyVariant = keyVar;
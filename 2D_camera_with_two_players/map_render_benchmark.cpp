@@ -0,0 +1,128 @@
+#include <SDL2/SDL.h>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "tile_draw_list.h"
+
+//Measures the frame time of drawing square level maps of growing size, once by replaying every tile of the draw
+//list and letting SDL clip the ones off screen, and once through forEachVisibleTile as levelMapDisplay does.
+//Usage: map_render_benchmark [size]...
+//Maps of 50, 500, 2000 and 5000 tiles a side are generated when no size is given. Renders into an offscreen
+//surface, so it also runs on machines without a display
+
+const int SCREEN_WIDTH = 800;
+const int SCREEN_HEIGHT = 800;
+const int TILE_SIZE = 40;
+const int TILE_COUNT = 14;
+const int FRAMES = 200;
+const int FULL_SCAN_MAX_SIZE = 2000; // replaying every tile of bigger maps would take minutes
+
+void generateDrawList(int size, std::vector<TileDraw>& drawList, std::vector<int>& rowStart);
+double measureFrames(SDL_Renderer* renderer, SDL_Texture* atlas, const std::vector<TileDraw>& drawList,
+                     const std::vector<int>& rowStart, int size, bool visibleOnly);
+
+int main(int argc, char* args[])
+{
+    std::vector<int> sizes;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::atoi(args[i]) <= 0)
+        {
+            printf("Usage: map_render_benchmark [size]...\n");
+            return 1;
+        }
+        sizes.push_back(std::atoi(args[i]));
+    }
+    if (sizes.empty())
+    {
+        sizes = { 50, 500, 2000, 5000 };
+    }
+
+    //A stand-in atlas with one column per tile, the same layout LTileAtlas packs
+    SDL_Surface* target = SDL_CreateRGBSurfaceWithFormat(0, SCREEN_WIDTH, SCREEN_HEIGHT, 32, SDL_PIXELFORMAT_RGB888);
+    SDL_Renderer* renderer = target == nullptr ? nullptr : SDL_CreateSoftwareRenderer(target);
+    SDL_Surface* tiles = SDL_CreateRGBSurfaceWithFormat(0, TILE_SIZE * TILE_COUNT, TILE_SIZE, 32, SDL_PIXELFORMAT_RGB888);
+    SDL_Texture* atlas = renderer == nullptr || tiles == nullptr ? nullptr : SDL_CreateTextureFromSurface(renderer, tiles);
+    if (atlas == nullptr)
+    {
+        printf("Software renderer could not be created! SDL Error: %s\n", SDL_GetError());
+        return 1;
+    }
+
+    printf("%-14s %14s %18s %18s\n", "map", "tiles", "every tile", "visible range");
+    for (int size : sizes)
+    {
+        std::vector<TileDraw> drawList;
+        std::vector<int> rowStart;
+        generateDrawList(size, drawList, rowStart);
+
+        char name[32];
+        snprintf(name, sizeof(name), "%dx%d", size, size);
+        printf("%-14s %14llu", name, (unsigned long long)drawList.size());
+        if (size <= FULL_SCAN_MAX_SIZE)
+        {
+            printf(" %13.3f ms", measureFrames(renderer, atlas, drawList, rowStart, size, false));
+        }
+        else
+        {
+            printf(" %16s", "skipped");
+        }
+        printf(" %13.3f ms\n", measureFrames(renderer, atlas, drawList, rowStart, size, true));
+    }
+    printf("Milliseconds per frame, averaged over %d frames panning across each map\n", FRAMES);
+
+    SDL_DestroyTexture(atlas);
+    SDL_FreeSurface(tiles);
+    SDL_DestroyRenderer(renderer);
+    SDL_FreeSurface(target);
+    return 0;
+}
+
+void generateDrawList(int size, std::vector<TileDraw>& drawList, std::vector<int>& rowStart)
+{
+    //Every tile of the level maps has an image, so every cell is in the draw list
+    drawList.clear();
+    drawList.reserve(size_t(size) * size);
+    rowStart.assign(1, 0);
+    srand(size);
+    for (int j = 0; j < size; j++)
+    {
+        for (int i = 0; i < size; i++)
+        {
+            drawList.push_back({ rand() % TILE_COUNT, i, j });
+        }
+        rowStart.push_back(drawList.size());
+    }
+}
+
+double measureFrames(SDL_Renderer* renderer, SDL_Texture* atlas, const std::vector<TileDraw>& drawList,
+                     const std::vector<int>& rowStart, int size, bool visibleOnly)
+{
+    //The camera moves diagonally across the map, clamped like the game clamps it
+    float maxCamera = std::max(0, size * TILE_SIZE - SCREEN_WIDTH);
+    Uint64 start = SDL_GetPerformanceCounter();
+    for (int frame = 0; frame < FRAMES; frame++)
+    {
+        float camera = maxCamera * frame / FRAMES;
+        auto draw = [renderer, atlas](const TileDraw& tile, float x, float y)
+        {
+            SDL_Rect clip = { tile.tile * TILE_SIZE, 0, TILE_SIZE, TILE_SIZE };
+            SDL_Rect quad = { (int)x, (int)y, TILE_SIZE, TILE_SIZE };
+            SDL_RenderCopy(renderer, atlas, &clip, &quad);
+        };
+        SDL_RenderClear(renderer);
+        if (visibleOnly)
+        {
+            forEachVisibleTile(drawList, rowStart, -camera, -camera, TILE_SIZE, TILE_SIZE, SCREEN_WIDTH, SCREEN_HEIGHT, draw);
+        }
+        else
+        {
+            for (const TileDraw& tile : drawList)
+            {
+                draw(tile, tile.column * TILE_SIZE - camera, tile.row * TILE_SIZE - camera);
+            }
+        }
+        SDL_RenderPresent(renderer);
+    }
+    return double(SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency() / FRAMES;
+}
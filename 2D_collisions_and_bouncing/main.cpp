@@ -4,8 +4,57 @@
 #include <string>
 #include <SDL2/SDL_image.h>
 #include <vector>
+#include <thread>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <algorithm>
+#include <map>
 #include <random>
 #include <ctime>
+#include "native_format.h"
+#include "async_loader.h"
+
+class LTextureCache
+{
+public:
+    //A decoded image shared by every LTexture loaded from the same path
+    struct Entry
+    {
+        std::string path;
+        SDL_Texture* texture = nullptr;
+        int width = 0;
+        int height = 0;
+        int refCount = 0;
+    };
+
+    //Returns the entry for path, decoding the image only on the first request
+    Entry* acquire(std::string path);
+
+    //Decodes the images in parallel and keeps them until they are acquired
+    void prefetch(std::vector<std::string> paths);
+
+    //Drops one reference, destroying the texture once nobody uses it
+    void release(Entry* entry);
+
+    //Destroys every cached texture
+    void clear();
+
+    //Cache statistics
+    int getHits() const {return hits;}
+    int getMisses() const {return misses;}
+    int getSize() const {return entries.size();}
+
+private:
+    //Creates the texture of a decoded surface and stores it under path, the surface is freed
+    Entry* insert(std::string path, SDL_Surface* surface);
+
+    std::map<std::string, Entry> entries;
+    int hits = 0;
+    int misses = 0;
+};
 
 class LTexture
 {
@@ -19,6 +68,9 @@ public:
     //Loads image at specified path
     bool loadFromFile(std::string path);
 
+    //Creates texture from a decoded surface, the surface is freed
+    bool loadFromSurface(SDL_Surface* surface);
+
     //Deallocate texture
     void free();
 
@@ -37,6 +89,9 @@ private:
     //Image dimensions
     int mWidth;
     int mHeight;
+
+    //Shared cache slot, set when the texture was loaded from a file
+    LTextureCache::Entry* mCacheEntry;
 };
 
 struct Circle {
@@ -63,6 +118,10 @@ LTexture separationTexture;
 LTexture separationOFFTexture;
 
 SDL_Renderer* gRenderer = nullptr;
+SDL_RendererInfo gRendererInfo;
+SDL_Surface* decodeSurface(std::string path);
+LAsyncLoader gLoader(decodeSurface);
+LTextureCache gTextureCache;
 std::vector<Circle *> circlesVector;
 std::vector<std::pair<Circle *, Circle*>> circlesColliding;
 
@@ -292,6 +351,9 @@ bool init()
                 //Initialize renderer color
                 SDL_SetRenderDrawColor(gRenderer, 0x44, 0x81, 0x88, 0xFF);
 
+                //Surfaces are converted to the texture formats this renderer prefers
+                SDL_GetRendererInfo(gRenderer, &gRendererInfo);
+
                 //Initialize PNG loading
                 int imgFlags = IMG_INIT_PNG;
                 if (!(IMG_Init(imgFlags) & imgFlags))
@@ -311,6 +373,10 @@ bool loadMedia()
 {
     //Loading success flag
     bool success = true;
+
+    //Decode every image on the worker pool up front, the loads below find them in the cache
+    gTextureCache.prefetch({"../bumping.png", "../bumpingOFF.png", "../separation.png", "../separationOFF.png", "../circle.png"});
+
     if (!bumpingTexture.loadFromFile("../bumping.png")) {
         printf("Failed to load bumping texture image!\n");
         success = false;
@@ -336,11 +402,22 @@ bool loadMedia()
 
 void close()
 {
+    //Join the loader workers
+    gLoader.stop();
+
     //Free loaded images
     bumpingTexture.free();
     bumpingOFFTexture.free();
     separationTexture.free();
     separationOFFTexture.free();
+    for (Circle* circle : circlesVector) {
+        delete circle;
+    }
+    circlesVector.clear();
+
+    //Destroy whatever is still cached
+    printf("Texture cache: %d hits, %d misses\n", gTextureCache.getHits(), gTextureCache.getMisses());
+    gTextureCache.clear();
 
     //Destroy window
     SDL_DestroyRenderer(gRenderer);
@@ -353,12 +430,117 @@ void close()
     SDL_Quit();
 }
 
+SDL_Surface* decodeSurface(std::string path)
+{
+    //Load image at specified path
+    return convertToNativeFormat(loadKeyedSurface(SDL_RWFromFile(path.c_str(), "rb"), path), gRendererInfo);
+}
+
+LTextureCache::Entry* LTextureCache::acquire(std::string path)
+{
+    //Reuse the texture if this image has already been decoded
+    std::map<std::string, Entry>::iterator found = entries.find(path);
+    if (found != entries.end())
+    {
+        hits++;
+        found->second.refCount++;
+        return &found->second;
+    }
+    misses++;
+
+    Entry* entry = insert(path, decodeSurface(path));
+    if (entry != nullptr)
+    {
+        entry->refCount++;
+    }
+    return entry;
+}
+
+void LTextureCache::prefetch(std::vector<std::string> paths)
+{
+    //Decode every missing image on the worker pool, only the uploads run on this thread
+    std::vector<std::future<SDL_Surface*>> surfaces(paths.size());
+    for (int i = 0; i < paths.size(); i++)
+    {
+        if (entries.find(paths[i]) == entries.end())
+        {
+            surfaces[i] = gLoader.loadSurface(paths[i]);
+        }
+    }
+
+    for (int i = 0; i < paths.size(); i++)
+    {
+        if (!surfaces[i].valid())
+        {
+            continue;
+        }
+        SDL_Surface* surface = surfaces[i].get();
+        if (entries.find(paths[i]) != entries.end())
+        {
+            //Listed twice
+            SDL_FreeSurface(surface);
+            continue;
+        }
+        misses++;
+        insert(paths[i], surface);
+    }
+}
+
+LTextureCache::Entry* LTextureCache::insert(std::string path, SDL_Surface* surface)
+{
+    if (surface == nullptr)
+    {
+        return nullptr;
+    }
+
+    //Create texture from surface pixels
+    SDL_Texture* newTexture = SDL_CreateTextureFromSurface(gRenderer, surface);
+    if (newTexture == NULL)
+    {
+        printf("Unable to create texture from %s! SDL Error: %s\n", path.c_str(), SDL_GetError());
+        SDL_FreeSurface(surface);
+        return nullptr;
+    }
+
+    Entry& entry = entries[path];
+    entry.path = path;
+    entry.texture = newTexture;
+    entry.width = surface->w;
+    entry.height = surface->h;
+    entry.refCount = 0;
+
+    //Get rid of old loaded surface
+    SDL_FreeSurface(surface);
+    return &entry;
+}
+
+void LTextureCache::release(Entry* entry)
+{
+    entry->refCount--;
+    if (entry->refCount <= 0)
+    {
+        SDL_DestroyTexture(entry->texture);
+        std::string path = entry->path;
+        entries.erase(path);
+    }
+}
+
+void LTextureCache::clear()
+{
+    for (std::map<std::string, Entry>::iterator it = entries.begin(); it != entries.end(); ++it)
+    {
+        SDL_DestroyTexture(it->second.texture);
+    }
+    entries.clear();
+}
+
 LTexture::LTexture()
 {
     //Initialize
     mTexture = NULL;
     mWidth = 0;
     mHeight = 0;
+    mCacheEntry = nullptr;
 }
 
 LTexture::~LTexture()
@@ -372,44 +554,59 @@ bool LTexture::loadFromFile(std::string path)
     //Get rid of preexisting texture
     free();
 
-    //The final texture
-    SDL_Texture* newTexture = nullptr;
+    //Share the texture with every other LTexture loaded from this path
+    mCacheEntry = gTextureCache.acquire(path);
+    if (mCacheEntry == nullptr)
+    {
+        return false;
+    }
+
+    mTexture = mCacheEntry->texture;
+    mWidth = mCacheEntry->width;
+    mHeight = mCacheEntry->height;
+    return true;
+}
+
+bool LTexture::loadFromSurface(SDL_Surface* surface)
+{
+    //Get rid of preexisting texture
+    free();
+
+    if (surface == nullptr)
+    {
+        return false;
+    }
 
-    //Load image at specified path
-    SDL_Surface* loadedSurface = IMG_Load(path.c_str());
-    if (loadedSurface == nullptr)
+    //Create texture from surface pixels
+    mTexture = SDL_CreateTextureFromSurface(gRenderer, surface);
+    if (mTexture == NULL)
     {
-        printf("Unable to load image %s! SDL_image Error: %s\n", path.c_str(), IMG_GetError());
+        printf("Unable to create texture from surface! SDL Error: %s\n", SDL_GetError());
     }
     else
     {
-        //Color key image
-        SDL_SetColorKey(loadedSurface, SDL_TRUE, SDL_MapRGB(loadedSurface->format, 0xFF, 0x11, 0x17));
-
-        //Create texture from surface pixels
-        newTexture = SDL_CreateTextureFromSurface(gRenderer, loadedSurface);
-        if (newTexture == NULL)
-        {
-            printf("Unable to create texture from %s! SDL Error: %s\n", path.c_str(), SDL_GetError());
-        }
-        else
-        {
-            //Get image dimensions
-            mWidth = loadedSurface->w;
-            mHeight = loadedSurface->h;
-        }
-
-        //Get rid of old loaded surface
-        SDL_FreeSurface(loadedSurface);
+        //Get image dimensions
+        mWidth = surface->w;
+        mHeight = surface->h;
     }
 
-    //Return success
-    mTexture = newTexture;
+    //Get rid of the decoded surface
+    SDL_FreeSurface(surface);
     return mTexture != NULL;
 }
 
 void LTexture::free()
 {
+    //Give a shared texture back to the cache instead of destroying it
+    if (mCacheEntry != nullptr)
+    {
+        gTextureCache.release(mCacheEntry);
+        mCacheEntry = nullptr;
+        mTexture = NULL;
+        mWidth = 0;
+        mHeight = 0;
+    }
+
     //Free texture if it exists
     if (mTexture != NULL)
     {
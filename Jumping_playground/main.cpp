@@ -6,13 +6,27 @@
 #include <SDL2/SDL_image.h>
 #include <SDL_ttf.h>
 #include <vector>
+#include <thread>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <algorithm>
+#include <map>
 #include <cmath>
 #include <stdlib.h>
 #include <time.h>
+#include "native_format.h"
+#include "async_loader.h"
 
 const int SCREEN_WIDTH = 1280;
 const int SCREEN_HEIGHT = 720;
 const int JOYSTICK_DEAD_ZONE = 10000;
+const int GLYPH_FIRST = ' ';
+const int GLYPH_COUNT = '~' - ' ' + 1;
+const int GLYPH_ATLAS_WIDTH = 512;
+const int GLYPH_PADDING = 1;
 const int PLAYER_VELOCITY = 2;
 const float PLAYER_WIDTH = 0.5; // * map_tile_size
 float jumpHeight = 5.0f;
@@ -32,6 +46,52 @@ enum AVAILABLE_POSITIONS{
     UNAVAILABLE
 };
 
+class LTextureCache
+{
+public:
+    //A decoded image shared by every LTexture loaded from the same path
+    struct Entry
+    {
+        std::string path;
+        std::string key;
+        SDL_Texture* texture = nullptr;
+        int width = 0;
+        int height = 0;
+        int refCount = 0;
+    };
+
+    //Returns the entry for path, decoding the image only on the first request
+    Entry* acquire(std::string path);
+
+    //Returns the entry for path resampled to width x height, drawing it at that size is a 1:1 copy
+    Entry* acquireScaled(std::string path, int width, int height);
+
+    //Decodes the images in parallel and keeps them until they are acquired, resampled when a size is given
+    void prefetch(std::vector<std::string> paths, int width = 0, int height = 0);
+
+    //Drops one reference, destroying the texture once nobody uses it
+    void release(Entry* entry);
+
+    //Destroys every cached texture
+    void clear();
+
+    //Cache statistics
+    int getHits() const {return hits;}
+    int getMisses() const {return misses;}
+    int getSize() const {return entries.size();}
+
+private:
+    //Entries of resampled images are stored under the path with the size appended
+    static std::string keyOf(std::string path, int width, int height);
+
+    //Creates the texture of a decoded surface and stores it under key, the surface is freed
+    Entry* insert(std::string key, std::string path, SDL_Surface* surface);
+
+    std::map<std::string, Entry> entries;
+    int hits = 0;
+    int misses = 0;
+};
+
 class LTexture
 {
 public:
@@ -44,6 +104,12 @@ public:
     //Loads image at specified path
     bool loadFromFile(std::string path);
 
+    //Loads image at specified path resampled to the size it is drawn at
+    bool loadFromFile(std::string path, int width, int height);
+
+    //Creates texture from a decoded surface, the surface is freed
+    bool loadFromSurface(SDL_Surface* surface);
+
     //Creates image from font string
     bool loadFromRenderedText( std::string textureText, SDL_Color textColor );
 
@@ -66,11 +132,50 @@ private:
     //Image dimensions
     int mWidth;
     int mHeight;
+
+    //Shared cache slot, set when the texture was loaded from a file
+    LTextureCache::Entry* mCacheEntry;
+};
+
+class LGlyphAtlas
+{
+public:
+    //Initializes variables
+    LGlyphAtlas();
+
+    //Deallocate memory
+    ~LGlyphAtlas();
+
+    //Rasterizes the printable ASCII characters of font once, in white so any color can be applied when drawing
+    bool build(TTF_Font* font);
+
+    //Deallocate atlas texture
+    void free();
+
+    //Renders text with its top left corner at given point, one copy per glyph
+    void render(const char* text, int x, int y, SDL_Color color);
+
+    //Gets the width text is rendered with
+    int measure(const char* text) const;
+
+    //Gets the line height
+    int getHeight() const {return mHeight;}
+
+private:
+    //The texture holding every glyph
+    SDL_Texture* mTexture;
+
+    //Line height of the font
+    int mHeight;
+
+    //Source rectangles and pen advances of the glyphs, indexed from GLYPH_FIRST
+    SDL_Rect clips[GLYPH_COUNT];
+    int advances[GLYPH_COUNT];
 };
 
 struct Wall{
     Wall(float xp, float yp, float w, float h) : xp(xp), yp(yp), w(w), h(h) {
-        this->texture.loadFromFile("../level/wall_fill.png");
+        this->texture.loadFromFile("../level/wall_fill.png", w, h);
     }
     float xp, yp;
     float w, h;
@@ -130,9 +235,24 @@ public:
     std::vector<std::vector<int>> getAvailablePositions();
     std::vector<Wall*> getlevelWalls() { return levelWalls; }
 
+    //Replaces walls with the walls overlapping the rectangle at x, y of size w x h, in map order
+    void queryWalls(float x, float y, float w, float h, std::vector<Wall*>& walls);
+
 private:
+    //Clears the grid for a levelMapWidth x levelMapHeight map
+    void resetGrid();
+
     std::vector<Wall*> levelWalls;
     std::vector<std::vector<int>> availablePositions;
+
+    //Uniform grid over the map, one cell per tile holding its wall or nullptr
+    std::vector<Wall*> wallGrid;
+    int gridWidth;
+    int gridHeight;
+    int tileSize;
+
+    //Reused every frame for the walls on screen
+    std::vector<Wall*> visibleWalls;
 };
 
 std::string levelMapString = "";
@@ -150,12 +270,17 @@ double unprocessedTime = 0.0;
 float frameTime = 1 / 60.0;
 
 SDL_Renderer* gRenderer = nullptr;
+SDL_RendererInfo gRendererInfo;
+SDL_Surface* decodeSurface(std::string path);
+LAsyncLoader gLoader(decodeSurface);
+LTextureCache gTextureCache;
 SDL_Joystick* gGameController = NULL;
 SDL_Window* gWindow = nullptr;
 TTF_Font* gFont = nullptr;
-LTexture jumpHeightTexture;
-LTexture jumpLengthTexture;
-LTexture fasterFallingSwitch;
+LGlyphAtlas gGlyphs;
+int framesPerSecond = 0;
+int framesThisSecond = 0;
+Uint32 fpsTimer = 0;
 
 void input(Player& player, bool& quit);
 void update(Player& player, Level& level, double dt);
@@ -190,6 +315,9 @@ int main(int argc, char* args[])
             bool shouldRender = false;
             readLevelMap("../jump_map.txt");
             map_tile_size = SCREEN_WIDTH / 10;
+
+            //Tiles are resampled to the tile size once instead of being scaled on every draw
+            gTextureCache.prefetch({"../level/wall_fill.png", "../level/target.png"}, map_tile_size, map_tile_size);
             Level level(levelMapString);
             Player player((0.5 * levelMapWidth) * map_tile_size, (levelMapHeight - 4) * map_tile_size, "../circle.png", GAMEPAD);
 
@@ -259,8 +387,11 @@ void update(Player& player, Level& level, double dt) {
     if( camera_x > levelMapWidth  * map_tile_size - SCREEN_WIDTH  ) { camera_x = levelMapWidth  * map_tile_size - SCREEN_WIDTH ; }
     if( camera_y > levelMapHeight * map_tile_size - SCREEN_HEIGHT ) { camera_y = levelMapHeight * map_tile_size - SCREEN_HEIGHT; }
 
-    //checking if the players aren't colliding with the map
-    for (Wall* w : level.getlevelWalls()){
+    //checking if the players aren't colliding with the map, only the walls within a tile of the player can touch it
+    std::vector<Wall*> nearbyWalls;
+    level.queryWalls(player.getPosX() - map_tile_size, player.getPosY() - map_tile_size,
+                     player.getPWidth() + 2 * map_tile_size, player.getPHeight() + 2 * map_tile_size, nearbyWalls);
+    for (Wall* w : nearbyWalls){
         if (SDL_NumJoysticks() > 0 && gGameController != nullptr) {
             checkCircularCollision(player, w, level);
         }
@@ -280,9 +411,26 @@ void render(Player& player, Level& level) {
 
     //rendering level map based on previously calculated camera position
     level.render(camera_x, camera_y);
-    jumpHeightTexture.render1(20, SCREEN_HEIGHT - jumpHeightTexture.getHeight() - 10);
-    jumpLengthTexture.render1(20, SCREEN_HEIGHT - 2 * jumpLengthTexture.getHeight() - 20);
-    fasterFallingSwitch.render1(400, SCREEN_HEIGHT - jumpHeightTexture.getHeight() - 10);
+
+    //HUD text is formatted on the stack and drawn from the glyph atlas, nothing is allocated or uploaded
+    SDL_Color textColor = { 0, 0, 0 };
+    char text[64];
+    snprintf(text, sizeof(text), "Jump height: %f", jumpHeight);
+    gGlyphs.render(text, 20, SCREEN_HEIGHT - gGlyphs.getHeight() - 10, textColor);
+    snprintf(text, sizeof(text), "Jump length: %f", jumpLength);
+    gGlyphs.render(text, 20, SCREEN_HEIGHT - 2 * gGlyphs.getHeight() - 20, textColor);
+    gGlyphs.render(FASTER_FALLING_SWITCH ? "Faster falling: ON" : "Faster falling: OFF", 400, SCREEN_HEIGHT - gGlyphs.getHeight() - 10, textColor);
+
+    //Count the frames drawn during each second
+    framesThisSecond++;
+    if (SDL_GetTicks() - fpsTimer >= 1000)
+    {
+        framesPerSecond = framesThisSecond;
+        framesThisSecond = 0;
+        fpsTimer = SDL_GetTicks();
+    }
+    snprintf(text, sizeof(text), "FPS: %d", framesPerSecond);
+    gGlyphs.render(text, SCREEN_WIDTH - gGlyphs.measure(text) - 20, 10, textColor);
 
     //Update screen
     SDL_RenderPresent(gRenderer);
@@ -325,6 +473,9 @@ bool init()
                 //Initialize renderer color #b53921
                 SDL_SetRenderDrawColor(gRenderer, 0xb5, 0x39, 0x21, 0xFF);
 
+                //Surfaces are converted to the texture formats this renderer prefers
+                SDL_GetRendererInfo(gRenderer, &gRendererInfo);
+
                 //Initialize PNG loading
                 int imgFlags = IMG_INIT_PNG;
                 if (!(IMG_Init(imgFlags) & imgFlags))
@@ -347,29 +498,37 @@ bool init()
 }
 
 bool readLevelMap(std::string filename) {
-    bool success = true;
     std::ifstream file;
     std::string line;
     file.open(filename);
-    levelMapString = "";
+    levelMapString.clear();
     levelMapHeight = 0;
     levelMapWidth = 0;
     if (!file.good()) {
         std::cout << "Wrong file " << filename << std::endl;
-        return !success;
+        return false;
     }
-    else {
-        levelMapString.clear();
-        while (!file.eof()) {
-            levelMapHeight++;
-            std::getline(file, line);
-            levelMapString += line;
+
+    //The width is the longest row, carriage returns and empty lines at the end are ignored
+    std::vector<std::string> rows;
+    while (std::getline(file, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
         }
-        levelMapWidth = line.size();
+        rows.push_back(line);
+        levelMapWidth = std::max(levelMapWidth, (int)line.size());
+    }
+    while (!rows.empty() && rows.back().empty()) {
+        rows.pop_back();
+    }
+    levelMapHeight = rows.size();
 
-        file.close();
-        return success;
+    //Short rows are padded with empty tiles instead of shifting the rows below them
+    for (std::string& row : rows) {
+        row.resize(levelMapWidth, ' ');
+        levelMapString += row;
     }
+    return true;
 }
 
 bool loadMedia()
@@ -381,6 +540,9 @@ bool loadMedia()
 //        success = false;
 //    }
 
+    //Decode the player image on the worker pool while the font is opened
+    gTextureCache.prefetch({"../circle.png"});
+
     //Open the font
     gFont = TTF_OpenFont( "../SourceSansPro-Regular.ttf", 20 );
     if( gFont == NULL )
@@ -390,21 +552,10 @@ bool loadMedia()
     }
     else
     {
-        //Render text
-        SDL_Color textColor = { 0, 0, 0 };
-        if( !jumpHeightTexture.loadFromRenderedText("Jump height: " + std::to_string(jumpHeight), textColor ) )
-        {
-            printf( "Failed to render jump height text texture!\n" );
-            success = false;
-        }
-        if( !jumpLengthTexture.loadFromRenderedText("Jump length: " + std::to_string(jumpLength), textColor ) )
-        {
-            printf( "Failed to render jump length text texture!\n" );
-            success = false;
-        }
-        if( !fasterFallingSwitch.loadFromRenderedText("Faster falling: OFF", textColor ) )
+        //Rasterize the font once, HUD text is drawn from the glyph atlas
+        if( !gGlyphs.build(gFont) )
         {
-            printf( "Failed to render faster falling switch text texture!\n" );
+            printf( "Failed to build glyph atlas!\n" );
             success = false;
         }
     }
@@ -416,8 +567,11 @@ bool loadMedia()
 
 void close()
 {
+    //Join the loader workers
+    gLoader.stop();
+
     //Free loaded images
-    jumpHeightTexture.free();
+    gGlyphs.free();
 
     //Close game controller
     SDL_JoystickClose( gGameController );
@@ -427,6 +581,10 @@ void close()
     TTF_CloseFont( gFont );
     gFont = NULL;
 
+    //Destroy whatever is still cached
+    printf("Texture cache: %d hits, %d misses\n", gTextureCache.getHits(), gTextureCache.getMisses());
+    gTextureCache.clear();
+
     //Destroy window
     SDL_DestroyRenderer(gRenderer);
     SDL_DestroyWindow(gWindow);
@@ -439,12 +597,134 @@ void close()
     SDL_Quit();
 }
 
+SDL_Surface* decodeSurface(std::string path)
+{
+    //Load image at specified path
+    return convertToNativeFormat(loadKeyedSurface(SDL_RWFromFile(path.c_str(), "rb"), path), gRendererInfo);
+}
+
+LTextureCache::Entry* LTextureCache::acquire(std::string path)
+{
+    return acquireScaled(path, 0, 0);
+}
+
+LTextureCache::Entry* LTextureCache::acquireScaled(std::string path, int width, int height)
+{
+    //Reuse the texture if this image has already been decoded at this size
+    std::string key = keyOf(path, width, height);
+    std::map<std::string, Entry>::iterator found = entries.find(key);
+    if (found != entries.end())
+    {
+        hits++;
+        found->second.refCount++;
+        return &found->second;
+    }
+    misses++;
+
+    Entry* entry = insert(key, path, scaleSurface(decodeSurface(path), width, height));
+    if (entry != nullptr)
+    {
+        entry->refCount++;
+    }
+    return entry;
+}
+
+void LTextureCache::prefetch(std::vector<std::string> paths, int width, int height)
+{
+    //Decode every missing image on the worker pool, only the uploads run on this thread
+    std::vector<std::future<SDL_Surface*>> surfaces(paths.size());
+    for (int i = 0; i < paths.size(); i++)
+    {
+        if (entries.find(keyOf(paths[i], width, height)) == entries.end())
+        {
+            surfaces[i] = gLoader.loadSurface(paths[i], width, height);
+        }
+    }
+
+    for (int i = 0; i < paths.size(); i++)
+    {
+        if (!surfaces[i].valid())
+        {
+            continue;
+        }
+        SDL_Surface* surface = surfaces[i].get();
+        std::string key = keyOf(paths[i], width, height);
+        if (entries.find(key) != entries.end())
+        {
+            //Listed twice
+            SDL_FreeSurface(surface);
+            continue;
+        }
+        misses++;
+        insert(key, paths[i], surface);
+    }
+}
+
+std::string LTextureCache::keyOf(std::string path, int width, int height)
+{
+    if (width <= 0 || height <= 0)
+    {
+        return path;
+    }
+    return path + "@" + std::to_string(width) + "x" + std::to_string(height);
+}
+
+LTextureCache::Entry* LTextureCache::insert(std::string key, std::string path, SDL_Surface* surface)
+{
+    if (surface == nullptr)
+    {
+        return nullptr;
+    }
+
+    //Create texture from surface pixels
+    SDL_Texture* newTexture = SDL_CreateTextureFromSurface(gRenderer, surface);
+    if (newTexture == NULL)
+    {
+        printf("Unable to create texture from %s! SDL Error: %s\n", path.c_str(), SDL_GetError());
+        SDL_FreeSurface(surface);
+        return nullptr;
+    }
+
+    Entry& entry = entries[key];
+    entry.path = path;
+    entry.key = key;
+    entry.texture = newTexture;
+    entry.width = surface->w;
+    entry.height = surface->h;
+    entry.refCount = 0;
+
+    //Get rid of old loaded surface
+    SDL_FreeSurface(surface);
+    return &entry;
+}
+
+void LTextureCache::release(Entry* entry)
+{
+    entry->refCount--;
+    if (entry->refCount <= 0)
+    {
+        SDL_DestroyTexture(entry->texture);
+        std::string key = entry->key;
+        entries.erase(key);
+    }
+}
+
+void LTextureCache::clear()
+{
+    for (std::map<std::string, Entry>::iterator it = entries.begin(); it != entries.end(); ++it)
+    {
+        SDL_DestroyTexture(it->second.texture);
+    }
+    entries.clear();
+}
+
 LTexture::LTexture()
 {
     //Initialize
     mTexture = NULL;
     mWidth = 0;
     mHeight = 0;
+    mCacheEntry = nullptr;
 }
 
 LTexture::~LTexture()
@@ -454,48 +734,68 @@ LTexture::~LTexture()
 }
 
 bool LTexture::loadFromFile(std::string path)
+{
+    return loadFromFile(path, 0, 0);
+}
+
+bool LTexture::loadFromFile(std::string path, int width, int height)
 {
     //Get rid of preexisting texture
     free();
 
-    //The final texture
-    SDL_Texture* newTexture = nullptr;
+    //Share the texture with every other LTexture loaded from this path at this size
+    mCacheEntry = gTextureCache.acquireScaled(path, width, height);
+    if (mCacheEntry == nullptr)
+    {
+        return false;
+    }
 
-    //Load image at specified path
-    SDL_Surface* loadedSurface = IMG_Load(path.c_str());
-    if (loadedSurface == nullptr)
+    mTexture = mCacheEntry->texture;
+    mWidth = mCacheEntry->width;
+    mHeight = mCacheEntry->height;
+    return true;
+}
+
+bool LTexture::loadFromSurface(SDL_Surface* surface)
+{
+    //Get rid of preexisting texture
+    free();
+
+    if (surface == nullptr)
     {
-        printf("Unable to load image %s! SDL_image Error: %s\n", path.c_str(), IMG_GetError());
+        return false;
+    }
+
+    //Create texture from surface pixels
+    mTexture = SDL_CreateTextureFromSurface(gRenderer, surface);
+    if (mTexture == NULL)
+    {
+        printf("Unable to create texture from surface! SDL Error: %s\n", SDL_GetError());
     }
     else
     {
-        //Color key image
-        SDL_SetColorKey(loadedSurface, SDL_TRUE, SDL_MapRGB(loadedSurface->format, 0xFF, 0x11, 0x17));
-
-        //Create texture from surface pixels
-        newTexture = SDL_CreateTextureFromSurface(gRenderer, loadedSurface);
-        if (newTexture == NULL)
-        {
-            printf("Unable to create texture from %s! SDL Error: %s\n", path.c_str(), SDL_GetError());
-        }
-        else
-        {
-            //Get image dimensions
-            mWidth = loadedSurface->w;
-            mHeight = loadedSurface->h;
-        }
-
-        //Get rid of old loaded surface
-        SDL_FreeSurface(loadedSurface);
+        //Get image dimensions
+        mWidth = surface->w;
+        mHeight = surface->h;
     }
 
-    //Return success
-    mTexture = newTexture;
+    //Get rid of the decoded surface
+    SDL_FreeSurface(surface);
     return mTexture != NULL;
 }
 
 void LTexture::free()
 {
+    //Give a shared texture back to the cache instead of destroying it
+    if (mCacheEntry != nullptr)
+    {
+        gTextureCache.release(mCacheEntry);
+        mCacheEntry = nullptr;
+        mTexture = NULL;
+        mWidth = 0;
+        mHeight = 0;
+    }
+
     //Free texture if it exists
     if (mTexture != NULL)
     {
@@ -561,6 +861,143 @@ bool LTexture::loadFromRenderedText(std::string textureText, SDL_Color textColor
     return mTexture != NULL;
 }
 
+LGlyphAtlas::LGlyphAtlas()
+{
+    //Initialize
+    mTexture = NULL;
+    mHeight = 0;
+}
+
+LGlyphAtlas::~LGlyphAtlas()
+{
+    //Deallocate
+    free();
+}
+
+bool LGlyphAtlas::build(TTF_Font* font)
+{
+    //Get rid of preexisting atlas
+    free();
+
+    //Rasterize every glyph and lay them out in rows
+    SDL_Color white = { 255, 255, 255, 255 };
+    SDL_Surface* glyphs[GLYPH_COUNT];
+    int x = 0;
+    int y = 0;
+    int rowHeight = 0;
+    mHeight = TTF_FontHeight(font);
+    for (int i = 0; i < GLYPH_COUNT; i++)
+    {
+        int minX, maxX, minY, maxY;
+        if (TTF_GlyphMetrics(font, GLYPH_FIRST + i, &minX, &maxX, &minY, &maxY, &advances[i]) != 0)
+        {
+            advances[i] = 0;
+        }
+        clips[i] = { 0, 0, 0, 0 };
+        glyphs[i] = TTF_RenderGlyph_Blended(font, GLYPH_FIRST + i, white);
+        if (glyphs[i] == nullptr)
+        {
+            continue;
+        }
+
+        if (x + glyphs[i]->w > GLYPH_ATLAS_WIDTH)
+        {
+            x = 0;
+            y += rowHeight + GLYPH_PADDING;
+            rowHeight = 0;
+        }
+        clips[i] = { x, y, glyphs[i]->w, glyphs[i]->h };
+        x += glyphs[i]->w + GLYPH_PADDING;
+        rowHeight = std::max(rowHeight, glyphs[i]->h);
+    }
+
+    //Copy every glyph into a single transparent surface
+    bool success = true;
+    SDL_Surface* atlasSurface = SDL_CreateRGBSurfaceWithFormat(0, GLYPH_ATLAS_WIDTH, y + rowHeight, 32, SDL_PIXELFORMAT_RGBA32);
+    if (atlasSurface == nullptr)
+    {
+        printf("Unable to create glyph atlas surface! SDL Error: %s\n", SDL_GetError());
+        success = false;
+    }
+    else
+    {
+        for (int i = 0; i < GLYPH_COUNT; i++)
+        {
+            if (glyphs[i] != nullptr)
+            {
+                SDL_SetSurfaceBlendMode(glyphs[i], SDL_BLENDMODE_NONE);
+                SDL_BlitSurface(glyphs[i], NULL, atlasSurface, &clips[i]);
+            }
+        }
+
+        //Create texture from surface pixels
+        atlasSurface = convertToNativeFormat(atlasSurface, gRendererInfo);
+        mTexture = SDL_CreateTextureFromSurface(gRenderer, atlasSurface);
+        if (mTexture == NULL)
+        {
+            printf("Unable to create glyph atlas texture! SDL Error: %s\n", SDL_GetError());
+            success = false;
+        }
+        else
+        {
+            SDL_SetTextureBlendMode(mTexture, SDL_BLENDMODE_BLEND);
+        }
+        SDL_FreeSurface(atlasSurface);
+    }
+
+    //Get rid of rasterized glyphs
+    for (SDL_Surface* glyph : glyphs)
+    {
+        SDL_FreeSurface(glyph);
+    }
+
+    return success;
+}
+
+void LGlyphAtlas::free()
+{
+    //Free texture if it exists
+    if (mTexture != NULL)
+    {
+        SDL_DestroyTexture(mTexture);
+        mTexture = NULL;
+        mHeight = 0;
+    }
+}
+
+void LGlyphAtlas::render(const char* text, int x, int y, SDL_Color color)
+{
+    //Tint the white glyphs, the copies below are batched by the renderer
+    SDL_SetTextureColorMod(mTexture, color.r, color.g, color.b);
+    for (const char* c = text; *c != '\0'; c++)
+    {
+        int glyph = (unsigned char)*c - GLYPH_FIRST;
+        if (glyph < 0 || glyph >= GLYPH_COUNT)
+        {
+            continue;
+        }
+
+        //Set rendering space and render the glyph's part of the atlas to screen
+        SDL_Rect renderQuad = { x, y, clips[glyph].w, clips[glyph].h };
+        SDL_RenderCopy(gRenderer, mTexture, &clips[glyph], &renderQuad);
+        x += advances[glyph];
+    }
+}
+
+int LGlyphAtlas::measure(const char* text) const
+{
+    int width = 0;
+    for (const char* c = text; *c != '\0'; c++)
+    {
+        int glyph = (unsigned char)*c - GLYPH_FIRST;
+        if (glyph >= 0 && glyph < GLYPH_COUNT)
+        {
+            width += advances[glyph];
+        }
+    }
+    return width;
+}
+
 Player::Player(float x_pos, float y_pos, std::string tex, KEYVARIANTS keyVar)
 {
     keyVariant = keyVar;
@@ -647,33 +1084,23 @@ void Player::handleEvent(SDL_Event& e)
         //If a key was pressed
         if (e.type == SDL_KEYDOWN && e.key.repeat == 0)
         {
-            SDL_Color textColor = { 0, 0, 0 };
             //Adjust the velocity
             switch (e.key.keysym.sym)
             {
                 case SDLK_i:
                     jumpLength++;
-                    jumpLengthTexture.loadFromRenderedText("Jump length: " + std::to_string(jumpLength), textColor);
                     break;
                 case SDLK_o:
                     jumpHeight++;
-                    jumpHeightTexture.loadFromRenderedText("Jump height: " + std::to_string(jumpHeight), textColor);
                     break;
                 case SDLK_k:
                     if (jumpLength > 1) jumpLength--;
-                    jumpLengthTexture.loadFromRenderedText("Jump length: " + std::to_string(jumpLength), textColor);
                     break;
                 case SDLK_l:
                     if (jumpHeight > 1) jumpHeight--;
-                    jumpHeightTexture.loadFromRenderedText("Jump height: " + std::to_string(jumpHeight), textColor);
                     break;
                 case SDLK_g:
                     FASTER_FALLING_SWITCH = !FASTER_FALLING_SWITCH;
-                    if (FASTER_FALLING_SWITCH) {
-                        fasterFallingSwitch.loadFromRenderedText("Faster falling: ON", textColor);
-                    } else {
-                        fasterFallingSwitch.loadFromRenderedText("Faster falling: OFF", textColor);
-                    }
                     break;
             }
             GRAVITY = 2 * jumpHeight * (PLAYER_VELOCITY * PLAYER_VELOCITY) / (jumpLength * jumpLength);
@@ -755,19 +1182,22 @@ void Player::setPosition(float x, float y) {
 Level::Level(std::string map) {
     std::vector<int> line;
     availablePositions.clear();
+    resetGrid();
     for (int j = 0; j < levelMapHeight; j++) {
         for (int i = 0; i < levelMapWidth; i++) {
             switch (map[j * levelMapWidth + i])
             {
                 case '#':
                     levelWalls.push_back(new Wall(i * map_tile_size, j * map_tile_size, map_tile_size, map_tile_size));
+                    wallGrid[j * gridWidth + i] = levelWalls.back();
                     line.push_back(UNAVAILABLE);
                     break;
                 case 'o':
                     levelWalls.push_back(new Wall(i * map_tile_size, j * map_tile_size, map_tile_size, map_tile_size));
-                    levelWalls.back()->texture.loadFromFile("../level/target.png");
+                    levelWalls.back()->texture.loadFromFile("../level/target.png", map_tile_size, map_tile_size);
                     line.push_back(UNAVAILABLE);
                     levelWalls.back()->isTarget = true;
+                    wallGrid[j * gridWidth + i] = levelWalls.back();
                     break;
                 default:
                     std::cout << "Available position detected: " << i << ", " << j << ")" << std::endl;
@@ -794,19 +1224,22 @@ void Level::loadNewMap(std::string map) {
     }
     levelWalls.clear();
     availablePositions.clear();
+    resetGrid();
     for (int j = 0; j < levelMapHeight; j++) {
         for (int i = 0; i < levelMapWidth; i++) {
             switch (map[j * levelMapWidth + i])
             {
                 case '#':
                     levelWalls.push_back(new Wall(i * map_tile_size, j * map_tile_size, map_tile_size, map_tile_size));
+                    wallGrid[j * gridWidth + i] = levelWalls.back();
                     line.push_back(UNAVAILABLE);
                     break;
                 case 'o':
                     levelWalls.push_back(new Wall(i * map_tile_size, j * map_tile_size, map_tile_size, map_tile_size));
-                    levelWalls.back()->texture.loadFromFile("../level/target.png");
+                    levelWalls.back()->texture.loadFromFile("../level/target.png", map_tile_size, map_tile_size);
                     line.push_back(UNAVAILABLE);
                     levelWalls.back()->isTarget = true;
+                    wallGrid[j * gridWidth + i] = levelWalls.back();
                     break;
                 default:
                     line.push_back(AVAILABLE);
@@ -819,11 +1252,39 @@ void Level::loadNewMap(std::string map) {
 }
 
 void Level::render(float init_x, float init_y) {
-    for (Wall* w : levelWalls) {
+    queryWalls(init_x, init_y, SCREEN_WIDTH, SCREEN_HEIGHT, visibleWalls);
+    for (Wall* w : visibleWalls) {
         w->texture.render2(w->xp - init_x, w->yp - init_y, w->w, w->h);
     }
 }
 
+void Level::resetGrid() {
+    gridWidth = levelMapWidth;
+    gridHeight = levelMapHeight;
+    tileSize = map_tile_size;
+    wallGrid.assign(size_t(gridWidth) * gridHeight, nullptr);
+}
+
+void Level::queryWalls(float x, float y, float w, float h, std::vector<Wall*>& walls) {
+    //Only the cells under the rectangle are visited, however big the map is
+    walls.clear();
+    if (tileSize <= 0) {
+        return;
+    }
+    int firstColumn = std::max(0, (int)std::floor(x / tileSize));
+    int lastColumn = std::min(gridWidth - 1, (int)std::floor((x + w) / tileSize));
+    int firstRow = std::max(0, (int)std::floor(y / tileSize));
+    int lastRow = std::min(gridHeight - 1, (int)std::floor((y + h) / tileSize));
+    for (int j = firstRow; j <= lastRow; j++) {
+        for (int i = firstColumn; i <= lastColumn; i++) {
+            Wall* wall = wallGrid[size_t(j) * gridWidth + i];
+            if (wall != nullptr) {
+                walls.push_back(wall);
+            }
+        }
+    }
+}
+
 std::vector<std::vector<int>> Level::getAvailablePositions() {
     return availablePositions;
 }
@@ -5,6 +5,22 @@
 #include <string>
 #include <SDL2/SDL_image.h>
 #include <vector>
+#include <thread>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <cstring>
+#include <sstream>
+#include "native_format.h"
+#include "async_loader.h"
+#include "tile_draw_list.h"
+#include "tile_geometry.h"
+#include "level_cache.h"
 
 class LTexture
 {
@@ -18,6 +34,9 @@ public:
     //Loads image at specified path
     bool loadFromFile(std::string path);
 
+    //Creates texture from a decoded surface, the surface is freed
+    bool loadFromSurface(SDL_Surface* surface);
+
     //Deallocate texture
     void free();
 
@@ -38,6 +57,63 @@ private:
     int mHeight;
 };
 
+class LTileAtlas
+{
+public:
+    //Initializes variables
+    LTileAtlas();
+
+    //Deallocate memory
+    ~LTileAtlas();
+
+    //Packs the images at given paths into one texture, tile indices follow the order of paths
+    bool pack(std::vector<std::string> paths);
+
+    //Deallocate atlas texture
+    void free();
+
+    //Renders a single tile of the atlas
+    void render(int tile, int x, int y, int width, int height);
+
+    //Gets the source rectangle of a tile
+    const SDL_Rect& getClip(int tile) const {return clips[tile];}
+    const std::vector<SDL_Rect>& getClips() const {return clips;}
+
+    //Gets atlas texture and dimensions
+    SDL_Texture* getTexture() const {return mTexture;}
+    int getWidth() const {return mWidth;}
+    int getHeight() const {return mHeight;}
+
+private:
+    //The texture holding every tile
+    SDL_Texture* mTexture;
+
+    //Atlas dimensions
+    int mWidth;
+    int mHeight;
+
+    //Source rectangles of the tiles inside the atlas
+    std::vector<SDL_Rect> clips;
+};
+
+class LDirtyRegions
+{
+public:
+    //Marks a screen rectangle as changed, it is clipped to the screen and merged with the rectangles it overlaps
+    void add(SDL_Rect rect);
+
+    //Marks the whole screen as changed
+    void addScreen();
+
+    //The rectangles changed since the last clear, none of them overlap
+    const std::vector<SDL_Rect>& getRects() const {return rects;}
+    bool empty() const {return rects.empty();}
+    void clear() {rects.clear();}
+
+private:
+    std::vector<SDL_Rect> rects;
+};
+
 class Player
 {
 public:
@@ -79,19 +155,66 @@ private:
 
 const int SCREEN_WIDTH = 800;
 const int SCREEN_HEIGHT = 800;
+const int ATLAS_MIN_WIDTH = 1024;
+const int ATLAS_PADDING = 1;
 const int CIRCLE_SIZE = 40;
 const float CAMERA_SPEED = 0.5f;
 
+const char WINDOW_TITLE[] = "Level map loading from .txt file";
 SDL_Window* gWindow = nullptr;
 LTexture gCurrentTexture;
 LTexture circle;
 
 std::string levelMap = "";
-std::vector<LTexture> levelTextures;
+LTileAtlas levelAtlas;
 int levelMapWidth = 0;
 int levelMapHeight = 0;
 
+//The draws of row j are levelDrawList[levelDrawRowStart[j]] up to levelDrawList[levelDrawRowStart[j + 1]]
+std::vector<TileDraw> levelDrawList;
+std::vector<int> levelDrawRowStart;
+
+//The quads of levelDrawList against levelAtlas, rebuilt whenever either is loaded
+LTileGeometry levelGeometry;
+
+//Draw calls issued while rendering the current frame, shown in the window title. g switches the map between
+//one geometry batch and one copy per tile
+int gDrawCalls = 0;
+int drawCallsShown = -1;
+bool gUseGeometry = true;
+bool geometryShown = true;
+
+//The tile images of the atlas, the draw list refers to them by their index in this list
+const std::vector<std::string> LEVEL_TILES = {
+    "../level/left_top_corner.png",
+    "../level/top_edge.png",
+    "../level/right_top_corner.png",
+    "../level/left_edge.png",
+    "../level/floor.png",
+    "../level/right_edge.png",
+    "../level/left_bottom_corner.png",
+    "../level/bottom_edge.png",
+    "../level/right_bottom_corner.png",
+
+    "../level/bottom_left_bit.png",
+    "../level/bottom_right_bit.png",
+    "../level/top_left_bit.png",
+    "../level/top_right_bit.png",
+    "../level/wall_fill.png"
+};
+
+//Bump when readLevelMap builds the draw list differently, so caches of the old one are rebuilt
+const Uint32 LEVEL_DRAW_LIST_VERSION = 1;
+
 SDL_Renderer* gRenderer = nullptr;
+SDL_RendererInfo gRendererInfo;
+SDL_Surface* decodeSurface(std::string path);
+LAsyncLoader gLoader(decodeSurface);
+
+//The frame is kept in gFrame between presents, so only the regions that changed are drawn again and nothing
+//is drawn or presented while the scene stands still. Without target textures changed frames are drawn whole
+SDL_Texture* gFrame = NULL;
+LDirtyRegions gDirty;
 
 const Uint8* keys;
 Sint32 m_xpos = SCREEN_WIDTH / 2 - 100;
@@ -103,7 +226,10 @@ int levelMapPos_Y = 0;
 bool init();
 bool readLevelMap(std::string filename);
 void loadLevelMap();
-void levelMapDisplay(float init_x, float init_y);
+int levelTileIndex(char tile);
+void compileLevelDrawList();
+void showDrawCalls();
+void levelMapDisplay(float init_x, float init_y, const SDL_Rect& region);
 bool loadMedia();
 void close();
 
@@ -144,6 +270,13 @@ int main(int argc, char* args[])
             readLevelMap("../level_map.txt");
             loadLevelMap();
 
+            //What the last presented frame shows, a change marks the old and the new place dirty
+            float drawnCamera_x = camera_x;
+            float drawnCamera_y = camera_y;
+            SDL_Rect drawnPlayer = { 0, 0, 0, 0 };
+            SDL_Rect drawnCircle = { 0, 0, 0, 0 };
+            gDirty.addScreen();
+
             //While application is running
             while (!quit)
             {
@@ -156,6 +289,12 @@ int main(int argc, char* args[])
                         quit = true;
                     }
 
+                    //The window was uncovered or the kept frame was lost with the graphics device
+                    if (e.type == SDL_WINDOWEVENT || e.type == SDL_RENDER_TARGETS_RESET || e.type == SDL_RENDER_DEVICE_RESET)
+                    {
+                        gDirty.addScreen();
+                    }
+
                     player1.handleEvent(e);
 
                     if (e.type == SDL_MOUSEBUTTONDOWN) {
@@ -180,14 +319,16 @@ int main(int argc, char* args[])
                         mouse_offset_y = 0;
                     }
 
+                    if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_g && e.key.repeat == 0)
+                    {
+                        gUseGeometry = !gUseGeometry;
+                        gDirty.addScreen();
+                    }
+
                 }
 
-                //Clear screen
-                SDL_RenderClear(gRenderer);
-                levelMapDisplay(camera_x, camera_y);
                 if(keys[SDL_SCANCODE_D]) {
                     player1.move();
-                    player1.render();
                 } else {
                     if (keys[SDL_SCANCODE_UP])
                     {
@@ -206,12 +347,12 @@ int main(int argc, char* args[])
                         camera_x -= 1;
                     }
 
-                    if (camera_x < -std::abs(levelMapWidth * levelTextures[0].getWidth() - SCREEN_WIDTH)) {
-                        camera_x = -std::abs(levelMapWidth * levelTextures[0].getWidth() - SCREEN_WIDTH);
+                    if (camera_x < -std::abs(levelMapWidth * levelAtlas.getClip(0).w - SCREEN_WIDTH)) {
+                        camera_x = -std::abs(levelMapWidth * levelAtlas.getClip(0).w - SCREEN_WIDTH);
                         if(keys[SDL_SCANCODE_D]){player1.move();}
                     }
-                    if (camera_y < -std::abs(levelMapHeight * levelTextures[0].getHeight() - SCREEN_HEIGHT)) {
-                        camera_y = -std::abs(levelMapHeight * levelTextures[0].getHeight() - SCREEN_HEIGHT);
+                    if (camera_y < -std::abs(levelMapHeight * levelAtlas.getClip(0).h - SCREEN_HEIGHT)) {
+                        camera_y = -std::abs(levelMapHeight * levelAtlas.getClip(0).h - SCREEN_HEIGHT);
                         if(keys[SDL_SCANCODE_D]){player1.move();}
                     }
                     if (camera_x > 0) {
@@ -222,13 +363,61 @@ int main(int argc, char* args[])
                         camera_y = 0;
                         if(keys[SDL_SCANCODE_D]){player1.move();}
                     }
-                    player1.render();
                 }
 
-                circle.render(m_xpos - CIRCLE_SIZE / 2, m_ypos - CIRCLE_SIZE / 2, CIRCLE_SIZE, CIRCLE_SIZE);
+                //A scroll moves everything, a sprite only dirties where it was and where it is
+                SDL_Rect playerRect = { (int)player1.getPosX(), (int)player1.getPosY(), player1.getPWidth(), player1.getPHeight() };
+                SDL_Rect circleRect = { m_xpos - CIRCLE_SIZE / 2, m_ypos - CIRCLE_SIZE / 2, CIRCLE_SIZE, CIRCLE_SIZE };
+                if (camera_x != drawnCamera_x || camera_y != drawnCamera_y) {
+                    gDirty.addScreen();
+                }
+                if (!SDL_RectEquals(&playerRect, &drawnPlayer)) {
+                    gDirty.add(drawnPlayer);
+                    gDirty.add(playerRect);
+                }
+                if (!SDL_RectEquals(&circleRect, &drawnCircle)) {
+                    gDirty.add(drawnCircle);
+                    gDirty.add(circleRect);
+                }
+
+                //Nothing changed, sleep until something happens instead of presenting the same frame again
+                if (gDirty.empty()) {
+                    SDL_WaitEvent(NULL);
+                    continue;
+                }
+
+                //The backbuffer isn't kept between presents, without the kept frame all of it is drawn
+                bool keptFrame = gFrame != NULL && SDL_SetRenderTarget(gRenderer, gFrame) == 0;
+                if (!keptFrame) {
+                    gDirty.addScreen();
+                }
+                gDrawCalls = 0;
+                for (const SDL_Rect& region : gDirty.getRects()) {
+                    SDL_RenderSetClipRect(gRenderer, &region);
+                    SDL_RenderFillRect(gRenderer, &region);
+                    levelMapDisplay(camera_x, camera_y, region);
+                    if (SDL_HasIntersection(&region, &playerRect)) {
+                        player1.render();
+                    }
+                    if (SDL_HasIntersection(&region, &circleRect)) {
+                        circle.render(circleRect.x, circleRect.y, CIRCLE_SIZE, CIRCLE_SIZE);
+                    }
+                }
+                SDL_RenderSetClipRect(gRenderer, NULL);
+                if (keptFrame) {
+                    SDL_SetRenderTarget(gRenderer, NULL);
+                    SDL_RenderCopy(gRenderer, gFrame, NULL, NULL);
+                    gDrawCalls++;
+                }
+                gDirty.clear();
+                drawnCamera_x = camera_x;
+                drawnCamera_y = camera_y;
+                drawnPlayer = playerRect;
+                drawnCircle = circleRect;
 
                 //Update screen
                 SDL_RenderPresent(gRenderer);
+                showDrawCalls();
             }
         }
     }
@@ -251,7 +440,7 @@ bool init()
     else
     {
         //Create window
-        gWindow = SDL_CreateWindow("Level map loading from .txt file", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN);
+        gWindow = SDL_CreateWindow(WINDOW_TITLE, SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN);
         if (gWindow == NULL)
         {
             printf("Window could not be created! SDL_Error: %s\n", SDL_GetError());
@@ -271,6 +460,19 @@ bool init()
                 //Initialize renderer color
                 SDL_SetRenderDrawColor(gRenderer, 0x44, 0x81, 0x88, 0xFF);
 
+                //Surfaces are converted to the texture formats this renderer prefers
+                SDL_GetRendererInfo(gRenderer, &gRendererInfo);
+
+                //The frame kept between presents, drawing goes to the window when it can't be made
+                if (gRendererInfo.flags & SDL_RENDERER_TARGETTEXTURE)
+                {
+                    gFrame = SDL_CreateTexture(gRenderer, SDL_GetWindowPixelFormat(gWindow), SDL_TEXTUREACCESS_TARGET, SCREEN_WIDTH, SCREEN_HEIGHT);
+                }
+                if (gFrame == NULL)
+                {
+                    printf("Frame texture could not be created, every changed frame is drawn whole! SDL Error: %s\n", SDL_GetError());
+                }
+
                 //Initialize PNG loading
                 int imgFlags = IMG_INIT_PNG;
                 if (!(IMG_Init(imgFlags) & imgFlags))
@@ -286,116 +488,153 @@ bool init()
 }
 
 bool readLevelMap(std::string filename) {
-    bool success = true;
-    std::ifstream file;
+    std::ifstream file(filename, std::ios::binary);
     std::string line;
-    file.open(filename);
+    levelMap.clear();
+    levelMapHeight = 0;
+    levelMapWidth = 0;
     if (!file.good()) {
         std::cout << "Wrong file " << filename << std::endl;
-        return !success;
-    }
-    else {
-        levelMap.clear();
-        while (!file.eof()) {
-            levelMapHeight++;
-            std::getline(file, line);
-            levelMap += line;
+        return false;
+    }
+
+    //The draw list built from this same map and tile list on an earlier start is read back instead. The map is
+    //matched by its size and time, its text is only read and hashed when those changed
+    std::string text;
+    bool textRead = false;
+    auto readText = [&]() {
+        if (!textRead) {
+            text.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            textRead = true;
         }
-        levelMapWidth = line.size();
+        return hashBytes(text.data(), text.size());
+    };
+    LevelCacheSource source = levelCacheSource(filename, levelTilesKey(LEVEL_TILES, LEVEL_DRAW_LIST_VERSION));
+    std::string cachePath = filename + ".cache";
+    auto isValid = [](const std::vector<TileDraw>& drawList, const std::vector<int>& rowStart, int width) {
+        return isValidDrawList(drawList, rowStart, width, LEVEL_TILES.size());
+    };
+    if (readLevelCache(cachePath, source, readText, levelDrawList, levelDrawRowStart, levelMapWidth, levelMapHeight, isValid)) {
+        return true;
+    }
+    source.textKey = readText();
+
+    //The width is the longest row, carriage returns and empty lines at the end are ignored
+    std::istringstream lines(text);
+    std::vector<std::string> rows;
+    while (std::getline(lines, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        rows.push_back(line);
+        levelMapWidth = std::max(levelMapWidth, (int)line.size());
+    }
+    while (!rows.empty() && rows.back().empty()) {
+        rows.pop_back();
+    }
+    levelMapHeight = rows.size();
 
-        file.close();
-        return success;
+    //Short rows are padded with empty tiles instead of shifting the rows below them
+    for (std::string& row : rows) {
+        row.resize(levelMapWidth, ' ');
+        levelMap += row;
     }
+    compileLevelDrawList();
+    writeLevelCache(cachePath, source, levelDrawList, levelDrawRowStart, levelMapWidth, levelMapHeight);
+    return true;
 }
 
 void loadLevelMap() {
-    levelTextures.resize(14);
-    levelTextures[0].loadFromFile("../level/left_top_corner.png");
-    levelTextures[1].loadFromFile("../level/top_edge.png");
-    levelTextures[2].loadFromFile("../level/right_top_corner.png");
-    levelTextures[3].loadFromFile("../level/left_edge.png");
-    levelTextures[4].loadFromFile("../level/floor.png");
-    levelTextures[5].loadFromFile("../level/right_edge.png");
-    levelTextures[6].loadFromFile("../level/left_bottom_corner.png");
-    levelTextures[7].loadFromFile("../level/bottom_edge.png");
-    levelTextures[8].loadFromFile("../level/right_bottom_corner.png");
-
-    levelTextures[9].loadFromFile("../level/bottom_left_bit.png");
-    levelTextures[10].loadFromFile("../level/bottom_right_bit.png");
-    levelTextures[11].loadFromFile("../level/top_left_bit.png");
-    levelTextures[12].loadFromFile("../level/top_right_bit.png");
-    levelTextures[13].loadFromFile("../level/wall_fill.png");
-}
-
-void levelMapDisplay(float init_x, float init_y) {
-    LTexture texture;
-    int y = 0;
+    //Tile indices used by levelMapDisplay follow the order of LEVEL_TILES
+    levelAtlas.pack(LEVEL_TILES);
+    levelGeometry.build(levelDrawList, levelAtlas.getClips(), levelAtlas.getWidth(), levelAtlas.getHeight());
+}
+
+int levelTileIndex(char tile) {
+    //Tile indices follow the order of the atlas packed in loadLevelMap, -1 for tiles that aren't drawn
+    switch (tile)
+    {
+        case '/': return 0;
+        case '.': return 1;
+        case '\\': return 2;
+        case '[': return 3;
+        case '-': return 4;
+        case ']': return 5;
+        case ':': return 6;
+        case '_': return 7;
+        case ';': return 8;
+        case 'L': return 9;
+        case 'J': return 10;
+        case '\'': return 11;
+        case '+': return 12;
+        case '#': return 13;
+        default: return -1;
+    }
+}
+
+void compileLevelDrawList() {
+    //The map is decoded once here, drawing only replays the list
+    levelDrawList.clear();
+    levelDrawRowStart.assign(1, 0);
     for (int j = 0; j < levelMapHeight; j++) {
         for (int i = 0; i < levelMapWidth; i++) {
-            switch (levelMap[j * levelMapWidth + i])
-            {
-                case '/':
-                    levelTextures[0].render(i * levelTextures[0].getWidth() + init_x, y * levelTextures[0].getHeight() + init_y);
-                    break;
-                case '.':
-                    levelTextures[1].render(i * levelTextures[1].getWidth() + init_x, y * levelTextures[1].getHeight() + init_y);
-                    break;
-                case '\\':
-                    levelTextures[2].render(i * levelTextures[2].getWidth() + init_x, y * levelTextures[2].getHeight() + init_y);
-                    break;
-                case '[':
-                    levelTextures[3].render(i * levelTextures[3].getWidth() + init_x, y * levelTextures[3].getHeight() + init_y);
-                    break;
-                case '-':
-                    levelTextures[4].render(i * levelTextures[4].getWidth() + init_x, y * levelTextures[4].getHeight() + init_y);
-                    break;
-                case ']':
-                    levelTextures[5].render(i * levelTextures[5].getWidth() + init_x, y * levelTextures[5].getHeight() + init_y);
-                    break;
-                case ':':
-                    levelTextures[6].render(i * levelTextures[6].getWidth() + init_x, y * levelTextures[6].getHeight() + init_y);
-                    break;
-                case '_':
-                    levelTextures[7].render(i * levelTextures[7].getWidth() + init_x, y * levelTextures[7].getHeight() + init_y);
-                    break;
-                case ';':
-                    levelTextures[8].render(i * levelTextures[8].getWidth() + init_x, y * levelTextures[8].getHeight() + init_y);
-                    break;
-                case 'L':
-                    levelTextures[9].render(i * levelTextures[9].getWidth() + init_x, y * levelTextures[9].getHeight() + init_y);
-                    break;
-                case 'J':
-                    levelTextures[10].render(i * levelTextures[10].getWidth() + init_x, y * levelTextures[10].getHeight() + init_y);
-                    break;
-                case '\'':
-                    levelTextures[11].render(i * levelTextures[11].getWidth() + init_x, y * levelTextures[11].getHeight() + init_y);
-                    break;
-                case '+':
-                    levelTextures[12].render(i * levelTextures[12].getWidth() + init_x, y * levelTextures[12].getHeight() + init_y);
-                    break;
-                case '#':
-                    levelTextures[13].render(i * levelTextures[13].getWidth() + init_x, y * levelTextures[13].getHeight() + init_y);
-                    break;
-                default:
-                    std::cout << std::endl;
-                    break;
+            int tile = levelTileIndex(levelMap[j * levelMapWidth + i]);
+            if (tile >= 0) {
+                levelDrawList.push_back({ tile, i, j });
             }
         }
-        y++;
+        levelDrawRowStart.push_back(levelDrawList.size());
     }
 }
 
+void levelMapDisplay(float init_x, float init_y, const SDL_Rect& region) {
+    //Every tile is drawn at its native size
+    int tile_w = levelAtlas.getClip(0).w;
+    int tile_h = levelAtlas.getClip(0).h;
+    if (tile_w <= 0 || tile_h <= 0) {
+        return;
+    }
+    //The tiles under the region go out in one batch where the renderer can draw geometry
+    if (gUseGeometry && levelGeometry.render(gRenderer, levelAtlas.getTexture(), levelDrawList, levelDrawRowStart, init_x, init_y,
+                                             tile_w, tile_h, region.x, region.y, region.w, region.h, gDrawCalls)) {
+        return;
+    }
+
+    //Only the tiles under the region of the screen and a tile around it are replayed, however big the map is
+    forEachTileInRegion(levelDrawList, levelDrawRowStart, init_x, init_y, tile_w, tile_h, region.x, region.y, region.w, region.h,
+                        [tile_w, tile_h](const TileDraw& draw, float x, float y) {
+                            levelAtlas.render(draw.tile, x, y, tile_w, tile_h);
+                        });
+}
+
+void showDrawCalls() {
+    //The title only changes with the numbers, setting it every frame would cost more than the draws
+    if (gDrawCalls == drawCallsShown && gUseGeometry == geometryShown) {
+        return;
+    }
+    char title[128];
+    snprintf(title, sizeof(title), "%s - draw calls: %d (%s)", WINDOW_TITLE, gDrawCalls, gUseGeometry ? "geometry" : "copies");
+    SDL_SetWindowTitle(gWindow, title);
+    drawCallsShown = gDrawCalls;
+    geometryShown = gUseGeometry;
+}
+
 bool loadMedia()
 {
     //Loading success flag
     bool success = true;
-    if (!circle.loadFromFile("../circle.png")) {
+
+    //Decode both images on the worker pool, only the uploads run on this thread
+    std::future<SDL_Surface*> circleSurface = gLoader.loadSurface("../circle.png");
+    std::future<SDL_Surface*> pressSurface = gLoader.loadSurface("../press.png");
+
+    if (!circle.loadFromSurface(circleSurface.get())) {
         printf("Failed to load Circle texture image!\n");
         success = false;
     }
 
     //Load default surface
-    if (!gCurrentTexture.loadFromFile("../press.png")) {
+    if (!gCurrentTexture.loadFromSurface(pressSurface.get())) {
         printf("Failed to load Press texture image!\n");
         success = false;
     }
@@ -405,9 +644,17 @@ bool loadMedia()
 
 void close()
 {
+    //Join the loader workers
+    gLoader.stop();
+
     //Free loaded images
     circle.free();
 
+    levelAtlas.free();
+
+    SDL_DestroyTexture(gFrame);
+    gFrame = NULL;
+
     //Destroy window
     SDL_DestroyRenderer(gRenderer);
     SDL_DestroyWindow(gWindow);
@@ -419,6 +666,12 @@ void close()
     SDL_Quit();
 }
 
+SDL_Surface* decodeSurface(std::string path)
+{
+    //Load image at specified path
+    return convertToNativeFormat(loadKeyedSurface(SDL_RWFromFile(path.c_str(), "rb"), path), gRendererInfo);
+}
+
 LTexture::LTexture()
 {
     //Initialize
@@ -434,43 +687,36 @@ LTexture::~LTexture()
 }
 
 bool LTexture::loadFromFile(std::string path)
+{
+    //Decode, color key and convert the image, then upload it
+    return loadFromSurface(decodeSurface(path));
+}
+
+bool LTexture::loadFromSurface(SDL_Surface* surface)
 {
     //Get rid of preexisting texture
     free();
 
-    //The final texture
-    SDL_Texture* newTexture = nullptr;
+    if (surface == nullptr)
+    {
+        return false;
+    }
 
-    //Load image at specified path
-    SDL_Surface* loadedSurface = IMG_Load(path.c_str());
-    if (loadedSurface == nullptr)
+    //Create texture from surface pixels
+    mTexture = SDL_CreateTextureFromSurface(gRenderer, surface);
+    if (mTexture == NULL)
     {
-        printf("Unable to load image %s! SDL_image Error: %s\n", path.c_str(), IMG_GetError());
+        printf("Unable to create texture from surface! SDL Error: %s\n", SDL_GetError());
     }
     else
     {
-        //Color key image
-        SDL_SetColorKey(loadedSurface, SDL_TRUE, SDL_MapRGB(loadedSurface->format, 0xFF, 0x11, 0x17));
-
-        //Create texture from surface pixels
-        newTexture = SDL_CreateTextureFromSurface(gRenderer, loadedSurface);
-        if (newTexture == NULL)
-        {
-            printf("Unable to create texture from %s! SDL Error: %s\n", path.c_str(), SDL_GetError());
-        }
-        else
-        {
-            //Get image dimensions
-            mWidth = loadedSurface->w;
-            mHeight = loadedSurface->h;
-        }
-
-        //Get rid of old loaded surface
-        SDL_FreeSurface(loadedSurface);
+        //Get image dimensions
+        mWidth = surface->w;
+        mHeight = surface->h;
     }
 
-    //Return success
-    mTexture = newTexture;
+    //Get rid of the decoded surface
+    SDL_FreeSurface(surface);
     return mTexture != NULL;
 }
 
@@ -491,6 +737,7 @@ void LTexture::render(int x, int y)
     //Set rendering space and render to screen
     SDL_Rect renderQuad = { x, y, mWidth, mHeight };
     SDL_RenderCopy(gRenderer, mTexture, NULL, &renderQuad);
+    gDrawCalls++;
 }
 
 void LTexture::render(int x, int y, int width, int height)
@@ -498,6 +745,7 @@ void LTexture::render(int x, int y, int width, int height)
     //Set rendering space and render to screen
     SDL_Rect renderQuad = { x, y, width, width };
     SDL_RenderCopy(gRenderer, mTexture, NULL, &renderQuad);
+    gDrawCalls++;
 }
 
 int LTexture::getWidth()
@@ -510,6 +758,138 @@ int LTexture::getHeight()
     return mHeight;
 }
 
+LTileAtlas::LTileAtlas()
+{
+    //Initialize
+    mTexture = NULL;
+    mWidth = 0;
+    mHeight = 0;
+}
+
+LTileAtlas::~LTileAtlas()
+{
+    //Deallocate
+    free();
+}
+
+bool LTileAtlas::pack(std::vector<std::string> paths)
+{
+    //Get rid of preexisting atlas
+    free();
+
+    bool success = true;
+    int atlasWidth = ATLAS_MIN_WIDTH;
+    std::vector<SDL_Surface*> surfaces(paths.size(), nullptr);
+    std::vector<int> order;
+
+    //Decode every image on the worker pool, decodeSurface already applies the color key
+    std::vector<std::future<SDL_Surface*>> decoded;
+    for (int i = 0; i < paths.size(); i++)
+    {
+        decoded.push_back(gLoader.loadSurface(paths[i]));
+    }
+
+    for (int i = 0; i < paths.size(); i++)
+    {
+        surfaces[i] = decoded[i].get();
+        if (surfaces[i] == nullptr)
+        {
+            success = false;
+            continue;
+        }
+
+        //Keyed pixels are skipped by the blit and stay transparent in the atlas
+        SDL_SetSurfaceBlendMode(surfaces[i], SDL_BLENDMODE_NONE);
+
+        atlasWidth = std::max(atlasWidth, surfaces[i]->w + 2 * ATLAS_PADDING);
+        order.push_back(i);
+    }
+
+    //Shelf packing: tallest images first, a new shelf starts when the current one is full
+    std::sort(order.begin(), order.end(), [&surfaces](int a, int b) { return surfaces[a]->h > surfaces[b]->h; });
+    clips.assign(paths.size(), SDL_Rect{0, 0, 0, 0});
+    int shelfX = 0;
+    int shelfY = 0;
+    int shelfHeight = 0;
+    for (int i : order)
+    {
+        int w = surfaces[i]->w + 2 * ATLAS_PADDING;
+        int h = surfaces[i]->h + 2 * ATLAS_PADDING;
+        if (shelfX + w > atlasWidth)
+        {
+            shelfX = 0;
+            shelfY += shelfHeight;
+            shelfHeight = 0;
+        }
+        clips[i] = { shelfX + ATLAS_PADDING, shelfY + ATLAS_PADDING, surfaces[i]->w, surfaces[i]->h };
+        shelfX += w;
+        shelfHeight = std::max(shelfHeight, h);
+    }
+
+    //Copy every tile into a single transparent surface
+    if (!order.empty())
+    {
+        SDL_Surface* atlasSurface = SDL_CreateRGBSurfaceWithFormat(0, atlasWidth, shelfY + shelfHeight, 32, SDL_PIXELFORMAT_RGBA32);
+        if (atlasSurface == nullptr)
+        {
+            printf("Unable to create atlas surface! SDL Error: %s\n", SDL_GetError());
+            success = false;
+        }
+        else
+        {
+            for (int i : order)
+            {
+                SDL_Rect destination = clips[i];
+                SDL_BlitSurface(surfaces[i], NULL, atlasSurface, &destination);
+            }
+
+            //Create texture from surface pixels
+            atlasSurface = convertToNativeFormat(atlasSurface, gRendererInfo);
+            mTexture = SDL_CreateTextureFromSurface(gRenderer, atlasSurface);
+            if (mTexture == NULL)
+            {
+                printf("Unable to create atlas texture! SDL Error: %s\n", SDL_GetError());
+                success = false;
+            }
+            else
+            {
+                mWidth = atlasSurface->w;
+                mHeight = atlasSurface->h;
+            }
+            SDL_FreeSurface(atlasSurface);
+        }
+    }
+
+    //Get rid of loaded surfaces
+    for (SDL_Surface* surface : surfaces)
+    {
+        SDL_FreeSurface(surface);
+    }
+
+    return success;
+}
+
+void LTileAtlas::free()
+{
+    //Free texture if it exists
+    if (mTexture != NULL)
+    {
+        SDL_DestroyTexture(mTexture);
+        mTexture = NULL;
+        mWidth = 0;
+        mHeight = 0;
+    }
+    clips.clear();
+}
+
+void LTileAtlas::render(int tile, int x, int y, int width, int height)
+{
+    //Set rendering space and render the tile's part of the atlas to screen
+    SDL_Rect renderQuad = { x, y, width, height };
+    SDL_RenderCopy(gRenderer, mTexture, &clips[tile], &renderQuad);
+    gDrawCalls++;
+}
+
 Player::Player(std::string tex)
 {
     texture.loadFromFile(tex);
@@ -612,3 +992,40 @@ int Player::getPWidth() const {
 int Player::getPHeight() const {
     return pHeight;
 }
+
+void LDirtyRegions::add(SDL_Rect rect)
+{
+    SDL_Rect screen = { 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT };
+    if (!SDL_IntersectRect(&rect, &screen, &rect))
+    {
+        return;
+    }
+
+    //Overlapping rectangles are joined, so no pixel is drawn twice in a frame
+    for (int i = 0; i < rects.size(); i++)
+    {
+        if (SDL_HasIntersection(&rect, &rects[i]))
+        {
+            SDL_UnionRect(&rect, &rects[i], &rect);
+            rects.erase(rects.begin() + i);
+            i = -1;
+        }
+    }
+    rects.push_back(rect);
+
+    //Past three quarters of the screen one rectangle over all of it costs about the same
+    int area = 0;
+    for (const SDL_Rect& r : rects)
+    {
+        area += r.w * r.h;
+    }
+    if (area * 4 > SCREEN_WIDTH * SCREEN_HEIGHT * 3)
+    {
+        addScreen();
+    }
+}
+
+void LDirtyRegions::addScreen()
+{
+    rects.assign(1, { 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT });
+}
@@ -0,0 +1,28 @@
+#ifndef ASSET_PACK_H
+#define ASSET_PACK_H
+
+#include <SDL2/SDL.h>
+
+//Layout of a pack file: AssetPackHeader, entryCount AssetPackEntry records, then the file contents.
+//Every file starts on an ASSET_PACK_ALIGNMENT boundary so it can be read in place from the mapping.
+struct AssetPackHeader
+{
+    char magic[4];
+    Uint32 version;
+    Uint32 entryCount;
+    Uint32 reserved;
+};
+
+//One file of the pack, path is relative to the asset root ("paralax_assets/Rock.png") and zero terminated
+struct AssetPackEntry
+{
+    char path[112];
+    Uint64 offset;
+    Uint64 size;
+};
+
+const char ASSET_PACK_MAGIC[4] = { 'A', 'P', 'A', 'K' };
+const Uint32 ASSET_PACK_VERSION = 1;
+const Uint64 ASSET_PACK_ALIGNMENT = 16;
+
+#endif
@@ -0,0 +1,111 @@
+#include <SDL2/SDL.h>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "asset_pack.h"
+
+//Packs loose asset files into one pack the game maps into memory at startup.
+//Usage: asset_packer <source dir> <output pack> <file>...
+//Every file path is relative to the source dir and is stored in the table of contents as given
+
+bool readFile(std::string path, std::vector<char>& contents);
+
+int main(int argc, char* args[])
+{
+    if (argc < 4)
+    {
+        printf("Usage: asset_packer <source dir> <output pack> <file>...\n");
+        return 1;
+    }
+
+    std::string sourceDir = args[1];
+    std::string output = args[2];
+
+    std::vector<AssetPackEntry> entries;
+    std::vector<std::vector<char>> contents;
+    Uint64 offset = sizeof(AssetPackHeader) + (argc - 3) * sizeof(AssetPackEntry);
+    for (int i = 3; i < argc; i++)
+    {
+        AssetPackEntry entry;
+        std::memset(&entry, 0, sizeof(entry));
+        if (std::strlen(args[i]) >= sizeof(entry.path))
+        {
+            printf("Path %s is too long for the table of contents!\n", args[i]);
+            return 1;
+        }
+        std::strcpy(entry.path, args[i]);
+
+        contents.push_back(std::vector<char>());
+        if (!readFile(sourceDir + "/" + args[i], contents.back()))
+        {
+            return 1;
+        }
+
+        //Keep every file aligned so the game can read it in place
+        offset = (offset + ASSET_PACK_ALIGNMENT - 1) / ASSET_PACK_ALIGNMENT * ASSET_PACK_ALIGNMENT;
+        entry.offset = offset;
+        entry.size = contents.back().size();
+        offset += entry.size;
+        entries.push_back(entry);
+    }
+
+    AssetPackHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, ASSET_PACK_MAGIC, sizeof(header.magic));
+    header.version = ASSET_PACK_VERSION;
+    header.entryCount = entries.size();
+
+    FILE* file = fopen(output.c_str(), "wb");
+    if (file == nullptr)
+    {
+        printf("Unable to write %s!\n", output.c_str());
+        return 1;
+    }
+    bool success = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   fwrite(entries.data(), sizeof(AssetPackEntry), entries.size(), file) == entries.size();
+    Uint64 written = sizeof(header) + entries.size() * sizeof(AssetPackEntry);
+    const char padding[ASSET_PACK_ALIGNMENT] = {};
+    for (int i = 0; success && i < entries.size(); i++)
+    {
+        success = fwrite(padding, 1, entries[i].offset - written, file) == entries[i].offset - written &&
+                  (contents[i].empty() || fwrite(contents[i].data(), contents[i].size(), 1, file) == 1);
+        written = entries[i].offset + entries[i].size;
+        printf("%s (%llu bytes)\n", entries[i].path, (unsigned long long)entries[i].size);
+    }
+    fclose(file);
+
+    if (!success)
+    {
+        printf("Unable to write %s!\n", output.c_str());
+        return 1;
+    }
+
+    printf("Packed %d files into %s (%llu bytes)\n", (int)entries.size(), output.c_str(), (unsigned long long)written);
+    return 0;
+}
+
+bool readFile(std::string path, std::vector<char>& contents)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr)
+    {
+        printf("Unable to open %s!\n", path.c_str());
+        return false;
+    }
+
+    char buffer[4096];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        contents.insert(contents.end(), buffer, buffer + count);
+    }
+    bool success = ferror(file) == 0;
+    fclose(file);
+
+    if (!success)
+    {
+        printf("Unable to read %s!\n", path.c_str());
+    }
+    return success;
+}
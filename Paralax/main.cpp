@@ -6,13 +6,49 @@
 #include <SDL2/SDL_image.h>
 #include <SDL_ttf.h>
 #include <vector>
+#include <thread>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <atomic>
+#include <cstring>
+#include <iterator>
 #include <cmath>
 #include <stdlib.h>
 #include <time.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "asset_pack.h"
+#include "native_format.h"
+#include "async_loader.h"
+#include "file_watcher.h"
+#include "level_cache.h"
 
 const int SCREEN_WIDTH = 1280;
 const int SCREEN_HEIGHT = 720;
+const int MAX_WALL_SCALE = 2; // tiles a scaled wall covers per side
+const int LAYER_STRIP_SIZE = 1024; // pixels a side of the pre-rendered pieces of a background layer
+const int LAYER_STRIP_BUILDS_PER_FRAME = 1; // pieces a background layer renders ahead of the camera each frame
+const int ATLAS_MIN_WIDTH = 1024;
+const int ATLAS_PADDING = 1;
 const int JOYSTICK_DEAD_ZONE = 10000;
+const int GLYPH_FIRST = ' ';
+const int GLYPH_COUNT = '~' - ' ' + 1;
+const int GLYPH_ATLAS_WIDTH = 512;
+const int GLYPH_PADDING = 1;
 const int PLAYER_VELOCITY = 2;
 const float PLAYER_WIDTH = 0.5; // * map_tile_size
 float jumpHeight = 5.0f;
@@ -21,18 +57,105 @@ float GRAVITY = 2 * jumpHeight * (PLAYER_VELOCITY * PLAYER_VELOCITY) / (jumpLeng
 bool FALLING = false;
 bool FASTER_FALLING_SWITCH = false;
 unsigned int DOUBLEJUMP = 2;
-float FRONTSPEED = 1.2;
-float BGROUND1SPEED = 0.4;
-float BGROUND2SPEED = 0.1;
 
 enum KEYVARIANTS {
     KEYBOARD,
     GAMEPAD
 };
 
-enum AVAILABLE_POSITIONS{
-    AVAILABLE,
-    UNAVAILABLE
+class LAssetPack
+{
+public:
+    //Initializes variables
+    LAssetPack();
+
+    //Unmaps the pack
+    ~LAssetPack();
+
+    //Maps the pack at path into memory, false when there is no usable pack
+    bool open(std::string path);
+
+    //Unmaps the pack, every asset is read from loose files afterwards
+    void close();
+
+    //Finds an asset by its loose file path ("../paralax_assets/Rock.png"), the bytes point into the mapping
+    bool find(std::string path, const char*& data, size_t& size);
+
+    //Opens an asset for SDL, read in place from the pack when it holds the file, from the loose file otherwise
+    SDL_RWops* openRW(std::string path);
+
+    //Drops path from the table of contents, an edited loose file is read instead of the packed copy from now on
+    void forget(std::string path);
+
+    //Path of the mapped pack, empty when none is open
+    std::string getPath() const {return mPath;}
+
+    //Pack statistics
+    int getPackedReads() const {return packedReads;}
+    int getLooseReads() const {return looseReads;}
+
+private:
+    //A file inside the mapping
+    struct File
+    {
+        const char* data;
+        size_t size;
+    };
+
+    //Table of contents, keyed by the loose file path the game asks for
+    std::map<std::string, File> files;
+
+    //The mapped pack
+    std::string mPath;
+    const char* mData;
+    size_t mSize;
+#ifdef _WIN32
+    HANDLE mFile;
+    HANDLE mMapping;
+#endif
+
+    //Assets are opened from the loader workers too
+    std::atomic<int> packedReads;
+    std::atomic<int> looseReads;
+};
+
+class LTextureCache
+{
+public:
+    //A decoded image shared by every LTexture loaded from the same path
+    struct Entry
+    {
+        std::string path;
+        SDL_Texture* texture = nullptr;
+        int width = 0;
+        int height = 0;
+        int refCount = 0;
+    };
+
+    //Returns the entry for path, decoding the image only on the first request
+    Entry* acquire(std::string path);
+
+    //Decodes the images in parallel and keeps them until they are acquired
+    void prefetch(std::vector<std::string> paths);
+
+    //Drops one reference, destroying the texture once nobody uses it
+    void release(Entry* entry);
+
+    //Destroys every cached texture
+    void clear();
+
+    //Cache statistics
+    int getHits() const {return hits;}
+    int getMisses() const {return misses;}
+    int getSize() const {return entries.size();}
+
+private:
+    //Creates the texture of a decoded surface and stores it under path, the surface is freed
+    Entry* insert(std::string path, SDL_Surface* surface);
+
+    std::map<std::string, Entry> entries;
+    int hits = 0;
+    int misses = 0;
 };
 
 class LTexture
@@ -47,6 +170,9 @@ public:
     //Loads image at specified path
     bool loadFromFile(std::string path);
 
+    //Creates texture from a decoded surface, the surface is freed
+    bool loadFromSurface(SDL_Surface* surface);
+
     //Creates image from font string
     bool loadFromRenderedText( std::string textureText, SDL_Color textColor );
 
@@ -69,18 +195,112 @@ private:
     //Image dimensions
     int mWidth;
     int mHeight;
+
+    //Shared cache slot, set when the texture was loaded from a file
+    LTextureCache::Entry* mCacheEntry;
+};
+
+class LTileAtlas
+{
+public:
+    //Initializes variables
+    LTileAtlas();
+
+    //Deallocate memory
+    ~LTileAtlas();
+
+    //Packs the images at given paths into one texture, tile indices follow the order of paths.
+    //With sizes, every tile is stored resampled to each of them, so drawing it at one of those sizes is a 1:1 copy
+    bool pack(std::vector<std::string> paths, std::vector<int> sizes = std::vector<int>());
+
+    //Deallocate atlas texture
+    void free();
+
+    //Decodes the image at path again and uploads it over every copy of tile, the atlas layout stays the same
+    bool reload(int tile, std::string path);
+
+    //Renders a single tile of the atlas
+    void render(int tile, int x, int y, int width, int height);
+
+    //Gets the source rectangle of a tile
+    const SDL_Rect& getClip(int tile) const {return clips[tile * std::max(1, (int)tileSizes.size())];}
+
+    //Gets the source rectangle a tile is drawn from at width x height, the copy resampled to that size if there is one
+    const SDL_Rect& getClip(int tile, int width, int height) const;
+
+    //Gets the atlas texture and its dimensions, for drawing tiles as geometry
+    SDL_Texture* getTexture() const {return mTexture;}
+    int getWidth() const {return mWidth;}
+    int getHeight() const {return mHeight;}
+
+private:
+    //The texture holding every tile
+    SDL_Texture* mTexture;
+
+    //Atlas dimensions
+    int mWidth;
+    int mHeight;
+
+    //Source rectangles of the tiles inside the atlas, one per tile and size
+    std::vector<SDL_Rect> clips;
+
+    //Square sizes every tile was resampled to
+    std::vector<int> tileSizes;
+};
+
+class LGlyphAtlas
+{
+public:
+    //Initializes variables
+    LGlyphAtlas();
+
+    //Deallocate memory
+    ~LGlyphAtlas();
+
+    //Rasterizes the printable ASCII characters of font once, in white so any color can be applied when drawing
+    bool build(TTF_Font* font);
+
+    //Deallocate atlas texture
+    void free();
+
+    //Renders text with its top left corner at given point, one copy per glyph
+    void render(const char* text, int x, int y, SDL_Color color);
+
+    //Gets the width text is rendered with
+    int measure(const char* text) const;
+
+    //Gets the line height
+    int getHeight() const {return mHeight;}
+
+private:
+    //The texture holding every glyph
+    SDL_Texture* mTexture;
+
+    //Line height of the font
+    int mHeight;
+
+    //Source rectangles and pen advances of the glyphs, indexed from GLYPH_FIRST
+    SDL_Rect clips[GLYPH_COUNT];
+    int advances[GLYPH_COUNT];
+};
+
+enum PARALAX_TILES {
+    PARALAX_GROUND,
+    PARALAX_SUN,
+    PARALAX_TREE,
+    PARALAX_ROCK,
+    PARALAX_CLOUD,
+    PARALAX_FLOWER
 };
 
 struct Wall{
-    Wall(float xp, float yp, float w, float h) : xp(xp), yp(yp), w(w), h(h) {
-        this->texture.loadFromFile("../level/wall_fill.png");
-    }
+    Wall(float xp, float yp, float w, float h, PARALAX_TILES tile) : xp(xp), yp(yp), w(w), h(h), tile(tile) {}
     float xp, yp;
     float w, h;
     int scale = 1;
     bool isActive = true;
     bool isTarget = false;
-    LTexture texture;
+    PARALAX_TILES tile;
 };
 
 class Player
@@ -125,33 +345,111 @@ private:
     float mPosX, mPosY;
 };
 
+//A tile of a layer that isn't empty, its row is implied by where it is stored
+struct LayerCell{
+    int column;
+    char tile;
+};
+
+//Layers are mostly sky, so only the occupied cells are kept, row by row and left to right.
+//The cells of row j are cells[rowStart[j]] up to cells[rowStart[j + 1]], runs of empty tiles take no memory
 struct Layer{
-    std::string mapString;
+    std::vector<LayerCell> cells;
+    std::vector<int> rowStart;
     int width;
     int height;
     int tileSize;
+
+    const LayerCell* rowBegin(int row) const { return cells.data() + rowStart[row]; }
+    const LayerCell* rowEnd(int row) const { return cells.data() + rowStart[row + 1]; }
 };
 
+const char LAYER_EMPTY_TILE = '-';
+
+//Bump when readLayer parses layers differently, so caches of the old cells are parsed again
+const Uint32 LAYER_CACHE_VERSION = 1;
+
 class Level{
 public:
-    Level(Layer layer, float speed = 1.0f);
+    Level(const Layer& layer, float speed = 1.0f);
     ~Level();
 
+    //Rebuilds the walls from layer, the speed is kept
+    void load(const Layer& layer);
+
     void render(float init_x, float init_y);
-    std::vector<std::vector<int>> getAvailablePositions();
     std::vector<Wall*> getlevelWalls() { return levelWalls; }
+    //Replaces walls with the walls overlapping the rectangle at x, y of size w x h in level coordinates, in map order
+    void queryWalls(float x, float y, float w, float h, std::vector<Wall*>& walls);
     void setSpeed(float speed) {this->speed = speed;}
 
+    //Builds the quads of every wall against paralaxAtlas, once the atlas is packed and again after every load
+    void buildGeometry();
+
+    //Splits the layer into pieces of LAYER_STRIP_SIZE pixels a side, each rendered into a target texture before it
+    //comes on screen and drawn from it after that. For layers that never change, called again whenever the layer or
+    //atlas does or the targets lose their pixels, which drops the pieces rendered so far
+    bool resetStrips();
+    void freeStrips();
+
 private:
+    //Submits the quads of the rows on screen in one call, false when the renderer can't draw geometry
+    bool renderGeometry(float init_x, float init_y);
+
+    //Copies the pieces on screen, renders a few of the pieces next to the screen and frees the pieces far from it,
+    //false when the layer has none
+    bool renderStrips(float init_x, float init_y);
+
+    //Renders the piece in column, row of the pieces, false when the renderer can't
+    bool buildStrip(int column, int row);
+
+    //Index in levelWalls of the first wall of row that is in column or right of it
+    int firstWallFrom(int row, int column) const;
+
+    //Walls row by row and left to right like the layer cells. The walls of row j are levelWalls[wallRowStart[j]]
+    //up to levelWalls[wallRowStart[j + 1]], a scaled wall is only in the row of its top left tile
     std::vector<Wall*> levelWalls;
-    std::vector<std::vector<int>> availablePositions;
+    std::vector<int> wallRowStart;
+
+    //Quads of the walls in level coordinates, four vertices per wall in the order of levelWalls, so the quads of a row
+    //start at its wallRowStart. indices is the same six indices per quad for any range of them
+    std::vector<SDL_Vertex> geometry;
+    std::vector<int> indices;
+
+    //Reused every frame for the quads on screen moved by the camera
+    std::vector<SDL_Vertex> translated;
+
+    int gridWidth;
+    int gridHeight;
+    int tileSize;
     float speed;
+
+    //Reused every frame for the walls on screen
+    std::vector<Wall*> visibleWalls;
+
+    //Pre-rendered pieces of the layer, row by row stripColumns to a row. A piece is nullptr until it is built
+    //and stays nullptr where the layer is empty. builtStrips lists the built pieces, so freeing them doesn't walk
+    //every piece of a long layer
+    std::vector<SDL_Texture*> strips;
+    std::vector<bool> stripBuilt;
+    std::vector<size_t> builtStrips;
+    int stripColumns = 0;
+    int stripRows = 0;
 };
 
-Layer frontGround;
-Layer backGround1;
-Layer backGround2;
-Layer backGround3;
+//One layer of the manifest, layers are drawn back to front in manifest order
+struct ParalaxLayer
+{
+    std::string path;
+    float speed = 1.0f;
+    Layer layer;
+    std::unique_ptr<Level> level;
+};
+
+std::vector<ParalaxLayer> paralaxLayers;
+
+//The layer the player walks on, the layers after it are drawn over the player
+int mainLayer = 0;
 
 float camera_x = 0.0f;
 float camera_y = 0.0f;
@@ -163,20 +461,51 @@ double unprocessedTime = 0.0;
 float frameTime = 1 / 60.0;
 
 SDL_Renderer* gRenderer = nullptr;
+SDL_RendererInfo gRendererInfo;
+LAssetPack gAssetPack;
+SDL_Surface* decodeSurface(std::string path);
+LAsyncLoader gLoader(decodeSurface);
+LTextureCache gTextureCache;
 SDL_Joystick* gGameController = NULL;
 SDL_Window* gWindow = nullptr;
 TTF_Font* gFont = nullptr;
-LTexture paralax1Texture;
-LTexture paralax2Texture;
-LTexture paralax3Texture;
+LGlyphAtlas gGlyphs;
+int framesPerSecond = 0;
+int framesThisSecond = 0;
+Uint32 fpsTimer = 0;
+LTileAtlas paralaxAtlas;
+
+//Draw calls issued while rendering the current frame and the last one, g switches the layers between
+//one geometry batch per layer and one copy per tile
+int gDrawCalls = 0;
+int drawCallsLastFrame = 0;
+bool gUseGeometry = true;
+int paralaxAtlasTileSize = 0;
+
+//Images of the atlas tiles, indices follow PARALAX_TILES
+std::vector<std::string> paralaxTilePaths = {
+        "../paralax_assets/ground.png",
+        "../paralax_assets/sun.png",
+        "../paralax_assets/tree_tile.png",
+        "../paralax_assets/Rock.png",
+        "../paralax_assets/cloud.png",
+        "../paralax_assets/flower.png"
+};
 
 void input(Player& player, bool& quit);
-void update(Player& player, Level& front, Level& back1, Level& back2, Level& back3, double dt);
-void render(Player& player, Level& front, Level& back1, Level& back2, Level& back3);
+void update(Player& player, double dt);
+void render(Player& player);
 bool init();
-bool readLevelMaps();
+bool readLayerManifest(std::string path);
+bool loadParalaxLayers(int tileSize);
+bool readLayer(std::string path, Layer& layer);
+bool isValidLayerCells(const std::vector<LayerCell>& cells, const std::vector<int>& rowStart, int width);
+void adjustLayerSpeed(int fromFront, float delta);
+void resetBackgroundStrips();
+void reloadAsset(std::string path);
 void checkCircularCollision(Player &circlePlayer, Wall* wall, Level &level);
 bool loadMedia();
+bool packParalaxTiles(int tileSize);
 void close();
 
 int main(int argc, char* args[])
@@ -201,16 +530,25 @@ int main(int argc, char* args[])
             srand(time(NULL));
 
             bool shouldRender = false;
-            readLevelMaps();
-            frontGround.tileSize = SCREEN_WIDTH / 10;
-            backGround1.tileSize = SCREEN_WIDTH / 10;
-            backGround2.tileSize = SCREEN_WIDTH / 10;
-            backGround3.tileSize = SCREEN_WIDTH / 10;
-            Level level(frontGround);
-            Level backgroundlevel1(backGround1, FRONTSPEED);
-            Level backgroundlevel2(backGround2, BGROUND1SPEED);
-            Level backgroundlevel3(backGround3, BGROUND2SPEED);
-            Player player((0.5 * frontGround.width) * frontGround.tileSize, (frontGround.height - 4) * frontGround.tileSize, frontGround.tileSize,"../circle.png", GAMEPAD);
+            readLayerManifest("../paralax_layers.txt");
+            if (!loadParalaxLayers(SCREEN_WIDTH / 10))
+            {
+                printf("Failed to load paralax layers!\n");
+            }
+            const Layer& front = paralaxLayers[mainLayer].layer;
+            Player player((0.5 * front.width) * front.tileSize, (front.height - 4) * front.tileSize, front.tileSize,"../circle.png", GAMEPAD);
+
+            //Edited layers and tiles are picked up while the game runs
+            LFileWatcher watcher;
+            for (const ParalaxLayer& layer : paralaxLayers)
+            {
+                watcher.watch(layer.path);
+            }
+            for (const std::string& path : paralaxTilePaths)
+            {
+                watcher.watch(path);
+            }
+            std::vector<std::string> changedFiles;
 
             //While application is running
             lastTime = SDL_GetTicks() * 0.01;
@@ -221,16 +559,25 @@ int main(int argc, char* args[])
                 lastTime = currentTime;
                 unprocessedTime += passedTime;
 
+                //Rebuild only what changed on disk
+                if (watcher.poll(changedFiles))
+                {
+                    for (const std::string& path : changedFiles)
+                    {
+                        reloadAsset(path);
+                    }
+                }
+
                 input(player, quit);
 
                 while (unprocessedTime >= frameTime) {
                     shouldRender = true;
                     unprocessedTime -= frameTime;
-                    update(player, level, backgroundlevel1, backgroundlevel2, backgroundlevel3, passedTime);
+                    update(player, passedTime);
                 }
 
                 if(shouldRender){
-                    render(player, level, backgroundlevel1, backgroundlevel2, backgroundlevel3);
+                    render(player);
                 }
             }
         }
@@ -251,11 +598,17 @@ void input(Player& player, bool& quit) {
             quit = true;
         }
 
+        //Target textures lose their pixels when the graphics device is reset, the pieces are rendered again
+        if (e.type == SDL_RENDER_TARGETS_RESET || e.type == SDL_RENDER_DEVICE_RESET)
+        {
+            resetBackgroundStrips();
+        }
+
         if (gGameController != NULL) { player.handleEvent(e); }
     }
 }
 
-void update(Player& player, Level& level, Level& back1, Level& back2, Level& back3, double dt) {
+void update(Player& player, double dt) {
     if (SDL_NumJoysticks() > 0) {
         if (gGameController == NULL) {
             gGameController = SDL_JoystickOpen(0);
@@ -275,38 +628,68 @@ void update(Player& player, Level& level, Level& back1, Level& back2, Level& bac
     //checking the camera movement
     if( camera_x < 0 ) { camera_x = 0; }
     if( camera_y < 0 ) { camera_y = 0; }
-    if( camera_x > frontGround.width  * frontGround.tileSize - SCREEN_WIDTH  ) { camera_x = frontGround.width  * frontGround.tileSize - SCREEN_WIDTH ; }
-    if( camera_y > frontGround.height * frontGround.tileSize - SCREEN_HEIGHT ) { camera_y = frontGround.height * frontGround.tileSize - SCREEN_HEIGHT; }
-
-    //checking if the players aren't colliding with the map
-    for (Wall* w : level.getlevelWalls()){
+    const Layer& front = paralaxLayers[mainLayer].layer;
+    if( camera_x > front.width  * front.tileSize - SCREEN_WIDTH  ) { camera_x = front.width  * front.tileSize - SCREEN_WIDTH ; }
+    if( camera_y > front.height * front.tileSize - SCREEN_HEIGHT ) { camera_y = front.height * front.tileSize - SCREEN_HEIGHT; }
+
+    //checking if the players aren't colliding with the map, only the walls within a tile of the player can touch it
+    Level& level = *paralaxLayers[mainLayer].level;
+    std::vector<Wall*> nearbyWalls;
+    level.queryWalls(player.getPosX() - front.tileSize, player.getPosY() - front.tileSize,
+                     player.getPWidth() + 2 * front.tileSize, player.getPHeight() + 2 * front.tileSize, nearbyWalls);
+    for (Wall* w : nearbyWalls){
         if (w->isActive && SDL_NumJoysticks() > 0 && gGameController != nullptr) {
             checkCircularCollision(player, w, level);
         }
     }
 
-    back1.setSpeed(FRONTSPEED);
-    back2.setSpeed(BGROUND1SPEED);
-    back3.setSpeed(BGROUND2SPEED);
+    for (ParalaxLayer& layer : paralaxLayers) {
+        layer.level->setSpeed(layer.speed);
+    }
 }
 
-void render(Player& player, Level& front, Level& back1, Level& back2, Level& back3) {
+void render(Player& player) {
     //Clear screen
     SDL_RenderClear(gRenderer);
+    gDrawCalls = 0;
 
-    //rendering level map based on previously calculated camera position
-    back3.render(camera_x, camera_y);
-    back2.render(camera_x, camera_y);
-    front.render(camera_x, camera_y);
-    //rendering players
-    if (gGameController != nullptr) {
-        player.render(camera_x, camera_y);
+    //rendering level map based on previously calculated camera position, back to front
+    for (int i = 0; i < paralaxLayers.size(); i++) {
+        paralaxLayers[i].level->render(camera_x, camera_y);
+
+        //rendering players
+        if (i == mainLayer && gGameController != nullptr) {
+            player.render(camera_x, camera_y);
+        }
+    }
+
+    //HUD text is formatted on the stack and drawn from the glyph atlas, nothing is allocated or uploaded.
+    //The speed of every layer but the main one, the frontmost at the top
+    SDL_Color textColor = { 255, 255, 255 };
+    char text[64];
+    int line = 1;
+    for (int i = 0; i < paralaxLayers.size(); i++) {
+        if (i == mainLayer) {
+            continue;
+        }
+        snprintf(text, sizeof(text), "%s: %f", paralaxLayers[i].path.c_str() + 3, paralaxLayers[i].speed);
+        gGlyphs.render(text, 20, SCREEN_HEIGHT - line * (gGlyphs.getHeight() + 10), textColor);
+        line++;
     }
-    back1.render(camera_x, camera_y);
 
-    paralax3Texture.render1(20, SCREEN_HEIGHT - paralax1Texture.getHeight() - 10);
-    paralax2Texture.render1(20, SCREEN_HEIGHT - 2 * paralax2Texture.getHeight() - 20);
-    paralax1Texture.render1(20, SCREEN_HEIGHT - 3 * paralax3Texture.getHeight() - 30);
+    //Count the frames drawn during each second
+    framesThisSecond++;
+    if (SDL_GetTicks() - fpsTimer >= 1000)
+    {
+        framesPerSecond = framesThisSecond;
+        framesThisSecond = 0;
+        fpsTimer = SDL_GetTicks();
+    }
+    snprintf(text, sizeof(text), "FPS: %d", framesPerSecond);
+    gGlyphs.render(text, SCREEN_WIDTH - gGlyphs.measure(text) - 20, 10, textColor);
+    snprintf(text, sizeof(text), "Draw calls: %d (%s)", drawCallsLastFrame, gUseGeometry ? "geometry" : "copies");
+    gGlyphs.render(text, SCREEN_WIDTH - gGlyphs.measure(text) - 20, 20 + gGlyphs.getHeight(), textColor);
+    drawCallsLastFrame = gDrawCalls;
 
     //Update screen
     SDL_RenderPresent(gRenderer);
@@ -349,6 +732,9 @@ bool init()
                 //Initialize renderer color #b53921
                 SDL_SetRenderDrawColor(gRenderer, 0xCA, 0xF5, 0xFF, 0xFF);
 
+                //Surfaces are converted to the texture formats this renderer prefers
+                SDL_GetRendererInfo(gRenderer, &gRendererInfo);
+
                 //Initialize PNG loading
                 int imgFlags = IMG_INIT_PNG;
                 if (!(IMG_Init(imgFlags) & imgFlags))
@@ -363,6 +749,12 @@ bool init()
                     printf( "SDL_ttf could not initialize! SDL_ttf Error: %s\n", TTF_GetError() );
                     success = false;
                 }
+
+                //Read assets from the pack built by the pack_assets target, loose files are the fallback
+                if (!gAssetPack.open("../paralax.pak"))
+                {
+                    printf("No asset pack, reading loose files\n");
+                }
             }
         }
     }
@@ -370,100 +762,240 @@ bool init()
     return success;
 }
 
-bool readLevelMaps() {
-    bool success = true;
-    std::ifstream file1;
-    std::ifstream file2;
-    std::ifstream file3;
-    std::ifstream file4;
-    std::string line;
-
+bool readLayerManifest(std::string path) {
+    //Read from the pack like every other asset
+    const char* data = nullptr;
+    size_t size = 0;
+    std::string looseFile;
+    if (!gAssetPack.find(path, data, size)) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file.good()) {
+            std::cout << "Wrong file " << path << std::endl;
+        }
+        looseFile.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        data = looseFile.data();
+        size = looseFile.size();
+    }
 
-    file1.open("../paralax1.txt");
-    frontGround.mapString = "";
-    frontGround.height = 0;
-    frontGround.width = 0;
-    if (!file1.good()) {
-        std::cout << "Wrong file paralax1" << std::endl;
-        return !success;
+    //Paths in the manifest are relative to the asset root, like the ones in the pack
+    paralaxLayers.clear();
+    mainLayer = -1;
+    std::istringstream manifest(std::string(data, size));
+    std::string line;
+    while (std::getline(manifest, line)) {
+        std::istringstream words(line);
+        std::string kind;
+        if (!(words >> kind) || kind[0] == '#') {
+            continue;
+        }
+        if (kind == "tiles") {
+            std::string tilePath;
+            for (int i = 0; i < paralaxTilePaths.size() && words >> tilePath; i++) {
+                paralaxTilePaths[i] = "../" + tilePath;
+            }
+        } else if (kind == "layer") {
+            paralaxLayers.push_back(ParalaxLayer());
+            ParalaxLayer& layer = paralaxLayers.back();
+            std::string flag;
+            if (!(words >> layer.path >> layer.speed)) {
+                std::cout << "Wrong layer in " << path << ": " << line << std::endl;
+                paralaxLayers.pop_back();
+                continue;
+            }
+            layer.path = "../" + layer.path;
+            if (words >> flag && flag == "main") {
+                mainLayer = paralaxLayers.size() - 1;
+            }
+        }
     }
-    else {
-        frontGround.mapString.clear();
-        while (!file1.eof()) {
-            frontGround.height++;
-            std::getline(file1, line);
-            frontGround.mapString += line;
+
+    //Without a usable manifest the scene the game always had is loaded
+    if (paralaxLayers.empty()) {
+        std::cout << "No layers in " << path << ", using the default scene" << std::endl;
+        std::string paths[] = { "../paralax3.txt", "../paralax2.txt", "../paralax1.txt", "../paralax-1.txt" };
+        float speeds[] = { 0.1f, 0.4f, 1.0f, 1.2f };
+        for (int i = 0; i < 4; i++) {
+            paralaxLayers.push_back(ParalaxLayer());
+            paralaxLayers.back().path = paths[i];
+            paralaxLayers.back().speed = speeds[i];
         }
-        frontGround.width = line.size();
+        mainLayer = 2;
+        return false;
+    }
+    if (mainLayer < 0) {
+        mainLayer = paralaxLayers.size() - 1;
+    }
+    return true;
+}
 
-        file1.close();
+bool loadParalaxLayers(int tileSize) {
+    //Every layer is read and built on its own thread while the atlas is packed here,
+    //so the load takes about as long as the largest layer however many there are
+    Uint64 loadBegin = SDL_GetPerformanceCounter();
+    std::vector<std::future<bool>> built;
+    for (ParalaxLayer& layer : paralaxLayers) {
+        ParalaxLayer* target = &layer;
+        built.push_back(std::async(std::launch::async, [target, tileSize]() {
+            bool read = readLayer(target->path, target->layer);
+            target->layer.tileSize = tileSize;
+            target->level.reset(new Level(target->layer, target->speed));
+            return read;
+        }));
     }
-    line.clear();
 
-    file2.open("../paralax-1.txt");
-    backGround1.mapString = "";
-    backGround1.height = 0;
-    backGround1.width = 0;
-    if (!file2.good()) {
-        std::cout << "Wrong file paralax2" << std::endl;
-        return !success;
+    bool success = packParalaxTiles(tileSize);
+    if (!success) {
+        printf("Failed to pack paralax tile atlas!\n");
     }
-    else {
-        backGround1.mapString.clear();
-        while (!file2.eof()) {
-            backGround1.height++;
-            std::getline(file2, line);
-            backGround1.mapString += line;
+    for (int i = 0; i < built.size(); i++) {
+        if (!built[i].get()) {
+            std::cout << "Wrong file " << paralaxLayers[i].path << std::endl;
+            success = false;
         }
-        backGround1.width = line.size();
+        paralaxLayers[i].level->buildGeometry();
+    }
+    if (success) {
+        resetBackgroundStrips();
+    }
+
+    printf("Loaded %d layers in %.2f ms\n", (int)paralaxLayers.size(),
+           (SDL_GetPerformanceCounter() - loadBegin) * 1000.0 / SDL_GetPerformanceFrequency());
+    return success;
+}
 
-        file2.close();
+void resetBackgroundStrips() {
+    //The layers behind the player never change while playing, they are drawn from pre-rendered pieces
+    for (int i = 0; i < mainLayer; i++) {
+        if (!paralaxLayers[i].level->resetStrips()) {
+            printf("Drawing %s tile by tile\n", paralaxLayers[i].path.c_str());
+        }
     }
-    line.clear();
+}
 
+void adjustLayerSpeed(int fromFront, float delta) {
+    //Counted from the frontmost layer, the main layer always scrolls with the camera
+    for (int i = paralaxLayers.size() - 1; i >= 0; i--) {
+        if (i == mainLayer) {
+            continue;
+        }
+        if (fromFront == 0) {
+            paralaxLayers[i].speed += delta;
+            return;
+        }
+        fromFront--;
+    }
+}
 
-    file3.open("../paralax2.txt");
-    backGround2.mapString = "";
-    backGround2.height = 0;
-    backGround2.width = 0;
-    if (!file3.good()) {
-        std::cout << "Wrong file paralax3" << std::endl;
-        return !success;
+bool readLayer(std::string path, Layer& layer) {
+    layer.cells.clear();
+    layer.rowStart.assign(1, 0);
+    layer.height = 0;
+    layer.width = 0;
+
+    //Parse straight out of the pack mapping, a loose file is read whole first
+    const char* data = nullptr;
+    size_t size = 0;
+    std::string looseFile;
+    bool packed = gAssetPack.find(path, data, size);
+    std::ifstream file;
+    if (!packed) {
+        file.open(path, std::ios::binary);
+        if (!file.good()) {
+            return false;
+        }
+    }
+    auto readText = [&]() {
+        if (!packed && data == nullptr) {
+            looseFile.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            data = looseFile.data();
+            size = looseFile.size();
+        }
+        return hashBytes(data, size);
+    };
+
+    //The cells parsed from this same text on an earlier start are read back instead. A packed layer is matched by
+    //the size and time of the pack, a loose one by its own; the text is only hashed when those changed
+    Uint64 parserKey = hashBytes((const char*)&LAYER_CACHE_VERSION, sizeof(LAYER_CACHE_VERSION));
+    LevelCacheSource source = levelCacheSource(packed ? gAssetPack.getPath() : path, parserKey);
+    std::string cachePath = path + ".cache";
+    if (readLevelCache(cachePath, source, readText, layer.cells, layer.rowStart, layer.width, layer.height, isValidLayerCells)) {
+        return true;
     }
-    else {
-        backGround2.mapString.clear();
-        while (!file3.eof()) {
-            backGround2.height++;
-            std::getline(file3, line);
-            backGround2.mapString += line;
+    source.textKey = readText();
+
+    //Only occupied tiles are stored, empty runs are skipped. The width is the longest row
+    const char* end = data + size;
+    const char* lineStart = data;
+    while (lineStart < end || layer.height == 0) {
+        const char* lineEnd = (const char*)memchr(lineStart, '\n', end - lineStart);
+        if (lineEnd == nullptr) {
+            lineEnd = end;
+        }
+        int length = lineEnd - lineStart;
+        if (length > 0 && lineStart[length - 1] == '\r') {
+            length--;
+        }
+        for (int i = 0; i < length; i++) {
+            if (lineStart[i] != LAYER_EMPTY_TILE && lineStart[i] != ' ') {
+                layer.cells.push_back({ i, lineStart[i] });
+            }
         }
-        backGround2.width = line.size();
+        layer.rowStart.push_back(layer.cells.size());
+        layer.width = std::max(layer.width, length);
+        layer.height++;
+        lineStart = lineEnd + 1;
+    }
+    writeLevelCache(cachePath, source, layer.cells, layer.rowStart, layer.width, layer.height);
+    return true;
+}
 
-        file3.close();
+bool isValidLayerCells(const std::vector<LayerCell>& cells, const std::vector<int>& rowStart, int width) {
+    //Every cell is an occupied tile inside the layer, in increasing column order within its row
+    for (size_t j = 0; j + 1 < rowStart.size(); j++) {
+        for (int c = rowStart[j]; c < rowStart[j + 1]; c++) {
+            const LayerCell& cell = cells[c];
+            if (cell.column < 0 || cell.column >= width || cell.tile == LAYER_EMPTY_TILE || cell.tile == ' ' ||
+                (c > rowStart[j] && cell.column <= cells[c - 1].column)) {
+                return false;
+            }
+        }
     }
-    line.clear();
+    return true;
+}
 
+void reloadAsset(std::string path) {
+    //The edited loose file replaces its packed copy
+    gAssetPack.forget(path);
 
-    file4.open("../paralax3.txt");
-    backGround3.mapString = "";
-    backGround3.height = 0;
-    backGround3.width = 0;
-    if (!file4.good()) {
-        std::cout << "Wrong file paralax4" << std::endl;
-        return !success;
+    bool reloaded = false;
+    for (ParalaxLayer& layer : paralaxLayers) {
+        if (path != layer.path) {
+            continue;
+        }
+        //Read aside and swapped in only when it worked, a layer still being saved keeps the running one
+        Layer read;
+        read.tileSize = layer.layer.tileSize;
+        if (!readLayer(path, read) || read.width <= 0) {
+            printf("Keeping the running layer, %s could not be read\n", path.c_str());
+            continue;
+        }
+        layer.layer = std::move(read);
+        layer.level->load(layer.layer);
+        layer.level->buildGeometry();
+        reloaded = true;
     }
-    else {
-        backGround3.mapString.clear();
-        while (!file4.eof()) {
-            backGround3.height++;
-            std::getline(file4, line);
-            backGround3.mapString += line;
+
+    for (int i = 0; i < paralaxTilePaths.size(); i++) {
+        if (path == paralaxTilePaths[i] && paralaxAtlas.reload(i, path)) {
+            reloaded = true;
         }
-        backGround3.width = line.size();
+    }
 
-        file4.close();
+    //The pre-rendered pieces are dropped and rendered again from the reloaded layer or tiles
+    if (reloaded) {
+        resetBackgroundStrips();
+        printf("Reloaded %s\n", path.c_str());
     }
-    return success;
 }
 
 bool loadMedia()
@@ -475,8 +1007,11 @@ bool loadMedia()
 //        success = false;
 //    }
 
+    //The player image decodes on the worker pool while the font is opened
+    gTextureCache.prefetch({"../circle.png"});
+
     //Open the font
-    gFont = TTF_OpenFont( "../SourceSansPro-Regular.ttf", 20 );
+    gFont = TTF_OpenFontRW( gAssetPack.openRW("../SourceSansPro-Regular.ttf"), 1, 20 );
     if( gFont == NULL )
     {
         printf( "Failed to load lazy font! SDL_ttf Error: %s\n", TTF_GetError() );
@@ -484,21 +1019,10 @@ bool loadMedia()
     }
     else
     {
-        //Render text
-        SDL_Color textColor = { 255, 255, 255 };
-        if( !paralax1Texture.loadFromRenderedText("Front layer: " + std::to_string(FRONTSPEED), textColor ) )
-        {
-            printf( "Failed to render jump height text texture!\n" );
-            success = false;
-        }
-        if( !paralax2Texture.loadFromRenderedText("Second layer: " + std::to_string(BGROUND1SPEED), textColor ) )
-        {
-            printf( "Failed to render jump length text texture!\n" );
-            success = false;
-        }
-        if( !paralax3Texture.loadFromRenderedText("Third layer: " + std::to_string(BGROUND2SPEED), textColor ) )
+        //Rasterize the font once, HUD text is drawn from the glyph atlas
+        if( !gGlyphs.build(gFont) )
         {
-            printf( "Failed to render faster falling switch text texture!\n" );
+            printf( "Failed to build glyph atlas!\n" );
             success = false;
         }
     }
@@ -508,12 +1032,30 @@ bool loadMedia()
     return success;
 }
 
+bool packParalaxTiles(int tileSize)
+{
+    //The atlas already holds tiles of this size
+    if (tileSize == paralaxAtlasTileSize)
+    {
+        return true;
+    }
+
+    //Every layer draws its tiles from one atlas, indices follow PARALAX_TILES.
+    //Tiles are drawn one or two tiles wide, both sizes are resampled up front
+    bool success = paralaxAtlas.pack(paralaxTilePaths, {tileSize, 2 * tileSize});
+    paralaxAtlasTileSize = success ? tileSize : 0;
+    return success;
+}
+
 void close()
 {
-    //Free loaded images
-    paralax1Texture.free();
-    paralax2Texture.free();
-    paralax3Texture.free();
+    //Join the loader workers
+    gLoader.stop();
+
+    //Free loaded images, the layers hold pre-rendered textures
+    gGlyphs.free();
+    paralaxAtlas.free();
+    paralaxLayers.clear();
 
     //Close game controller
     SDL_JoystickClose( gGameController );
@@ -523,6 +1065,14 @@ void close()
     TTF_CloseFont( gFont );
     gFont = NULL;
 
+    //Destroy whatever is still cached
+    printf("Texture cache: %d hits, %d misses\n", gTextureCache.getHits(), gTextureCache.getMisses());
+    gTextureCache.clear();
+
+    //Nothing reads from the pack anymore
+    printf("Asset pack: %d packed reads, %d loose reads\n", gAssetPack.getPackedReads(), gAssetPack.getLooseReads());
+    gAssetPack.close();
+
     //Destroy window
     SDL_DestroyRenderer(gRenderer);
     SDL_DestroyWindow(gWindow);
@@ -535,99 +1085,381 @@ void close()
     SDL_Quit();
 }
 
-LTexture::LTexture()
+SDL_Surface* decodeSurface(std::string path)
 {
-    //Initialize
-    mTexture = NULL;
-    mWidth = 0;
-    mHeight = 0;
+    //Load image at specified path, from the asset pack when it holds it
+    return convertToNativeFormat(loadKeyedSurface(gAssetPack.openRW(path), path), gRendererInfo);
 }
 
-LTexture::~LTexture()
+LAssetPack::LAssetPack()
 {
-    //Deallocate
-    free();
+    //Initialize
+    mData = nullptr;
+    mSize = 0;
+#ifdef _WIN32
+    mFile = INVALID_HANDLE_VALUE;
+    mMapping = NULL;
+#endif
+    packedReads = 0;
+    looseReads = 0;
 }
 
-bool LTexture::loadFromFile(std::string path)
+LAssetPack::~LAssetPack()
 {
-    //Get rid of preexisting texture
-    free();
+    close();
+}
 
-    //The final texture
-    SDL_Texture* newTexture = nullptr;
+bool LAssetPack::open(std::string path)
+{
+    //Get rid of a preexisting mapping
+    close();
 
-    //Load image at specified path
-    SDL_Surface* loadedSurface = IMG_Load(path.c_str());
-    if (loadedSurface == nullptr)
+#ifdef _WIN32
+    mFile = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (mFile == INVALID_HANDLE_VALUE)
     {
-        printf("Unable to load image %s! SDL_image Error: %s\n", path.c_str(), IMG_GetError());
+        return false;
     }
-    else
+    LARGE_INTEGER fileSize;
+    if (GetFileSizeEx(mFile, &fileSize) && fileSize.QuadPart > 0)
     {
-        //Color key image
-        SDL_SetColorKey(loadedSurface, SDL_TRUE, SDL_MapRGB(loadedSurface->format, 0xFF, 0x11, 0x17));
-
-        //Create texture from surface pixels
-        newTexture = SDL_CreateTextureFromSurface(gRenderer, loadedSurface);
-        if (newTexture == NULL)
+        mMapping = CreateFileMappingA(mFile, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mMapping != NULL)
         {
-            printf("Unable to create texture from %s! SDL Error: %s\n", path.c_str(), SDL_GetError());
+            mData = (const char*)MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+            mSize = fileSize.QuadPart;
         }
-        else
+    }
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0)
+    {
+        void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED)
         {
-            //Get image dimensions
-            mWidth = loadedSurface->w;
-            mHeight = loadedSurface->h;
+            mData = (const char*)mapping;
+            mSize = info.st_size;
         }
+    }
+    //The mapping stays valid without the descriptor
+    ::close(fd);
+#endif
 
-        //Get rid of old loaded surface
-        SDL_FreeSurface(loadedSurface);
+    if (mData == nullptr)
+    {
+        printf("Unable to map asset pack %s!\n", path.c_str());
+        close();
+        return false;
     }
 
-    //Return success
-    mTexture = newTexture;
-    return mTexture != NULL;
+    //Check the table of contents before trusting any offset in it
+    const AssetPackHeader* header = (const AssetPackHeader*)mData;
+    bool valid = mSize >= sizeof(AssetPackHeader) &&
+                 std::memcmp(header->magic, ASSET_PACK_MAGIC, sizeof(header->magic)) == 0 &&
+                 header->version == ASSET_PACK_VERSION &&
+                 (mSize - sizeof(AssetPackHeader)) / sizeof(AssetPackEntry) >= header->entryCount;
+    const AssetPackEntry* entries = (const AssetPackEntry*)(mData + sizeof(AssetPackHeader));
+    for (Uint32 i = 0; valid && i < header->entryCount; i++)
+    {
+        const AssetPackEntry& entry = entries[i];
+        valid = std::memchr(entry.path, 0, sizeof(entry.path)) != nullptr &&
+                entry.offset <= mSize && entry.size <= mSize - entry.offset;
+        if (valid)
+        {
+            //Packed paths are relative to the asset root, the game asks for them the way it opens loose files
+            files["../" + std::string(entry.path)] = { mData + entry.offset, size_t(entry.size) };
+        }
+    }
+
+    if (!valid)
+    {
+        printf("Asset pack %s is corrupt!\n", path.c_str());
+        close();
+        return false;
+    }
+
+    printf("Mapped asset pack %s: %d files, %d bytes\n", path.c_str(), (int)files.size(), (int)mSize);
+    mPath = path;
+    return true;
 }
 
-void LTexture::free()
+void LAssetPack::close()
 {
-    //Free texture if it exists
-    if (mTexture != NULL)
+    files.clear();
+    mPath.clear();
+#ifdef _WIN32
+    if (mData != nullptr)
     {
-        SDL_DestroyTexture(mTexture);
-        mTexture = NULL;
-        mWidth = 0;
-        mHeight = 0;
+        UnmapViewOfFile(mData);
+    }
+    if (mMapping != NULL)
+    {
+        CloseHandle(mMapping);
+        mMapping = NULL;
+    }
+    if (mFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(mFile);
+        mFile = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (mData != nullptr)
+    {
+        munmap((void*)mData, mSize);
     }
+#endif
+    mData = nullptr;
+    mSize = 0;
 }
 
-void LTexture::render1(int x, int y)
+bool LAssetPack::find(std::string path, const char*& data, size_t& size)
 {
-    //Set rendering space and render1 to screen
-    SDL_Rect renderQuad = { x, y, mWidth, mHeight };
-    SDL_RenderCopy(gRenderer, mTexture, NULL, &renderQuad);
+    std::map<std::string, File>::const_iterator found = files.find(path);
+    if (found == files.end())
+    {
+        return false;
+    }
+
+    packedReads++;
+    data = found->second.data;
+    size = found->second.size;
+    return true;
 }
 
-void LTexture::render2(int x, int y, int width, int height)
+SDL_RWops* LAssetPack::openRW(std::string path)
 {
-    //Set rendering space and render1 to screen
-    SDL_Rect renderQuad = { x, y, width, height };
-    SDL_RenderCopy(gRenderer, mTexture, NULL, &renderQuad);
-}
+    const char* data;
+    size_t size;
+    if (find(path, data, size))
+    {
+        return SDL_RWFromConstMem(data, (int)size);
+    }
 
-int LTexture::getWidth() const {
-    return mWidth;
+    //Development fallback, assets that are not packed are read from disk
+    looseReads++;
+    return SDL_RWFromFile(path.c_str(), "rb");
 }
 
-int LTexture::getHeight() const {
-    return mHeight;
+void LAssetPack::forget(std::string path)
+{
+    //Only called from the main loop while the loader workers are idle
+    files.erase(path);
 }
 
-bool LTexture::loadFromRenderedText(std::string textureText, SDL_Color textColor) {
-    //Get rid of preexisting texture
-    free();
-
+LTextureCache::Entry* LTextureCache::acquire(std::string path)
+{
+    //Reuse the texture if this image has already been decoded
+    std::map<std::string, Entry>::iterator found = entries.find(path);
+    if (found != entries.end())
+    {
+        hits++;
+        found->second.refCount++;
+        return &found->second;
+    }
+    misses++;
+
+    Entry* entry = insert(path, decodeSurface(path));
+    if (entry != nullptr)
+    {
+        entry->refCount++;
+    }
+    return entry;
+}
+
+void LTextureCache::prefetch(std::vector<std::string> paths)
+{
+    //Decode every missing image on the worker pool, only the uploads run on this thread
+    std::vector<std::future<SDL_Surface*>> surfaces(paths.size());
+    for (int i = 0; i < paths.size(); i++)
+    {
+        if (entries.find(paths[i]) == entries.end())
+        {
+            surfaces[i] = gLoader.loadSurface(paths[i]);
+        }
+    }
+
+    for (int i = 0; i < paths.size(); i++)
+    {
+        if (!surfaces[i].valid())
+        {
+            continue;
+        }
+        SDL_Surface* surface = surfaces[i].get();
+        if (entries.find(paths[i]) != entries.end())
+        {
+            //Listed twice
+            SDL_FreeSurface(surface);
+            continue;
+        }
+        misses++;
+        insert(paths[i], surface);
+    }
+}
+
+LTextureCache::Entry* LTextureCache::insert(std::string path, SDL_Surface* surface)
+{
+    if (surface == nullptr)
+    {
+        return nullptr;
+    }
+
+    //Create texture from surface pixels
+    SDL_Texture* newTexture = SDL_CreateTextureFromSurface(gRenderer, surface);
+    if (newTexture == NULL)
+    {
+        printf("Unable to create texture from %s! SDL Error: %s\n", path.c_str(), SDL_GetError());
+        SDL_FreeSurface(surface);
+        return nullptr;
+    }
+
+    Entry& entry = entries[path];
+    entry.path = path;
+    entry.texture = newTexture;
+    entry.width = surface->w;
+    entry.height = surface->h;
+    entry.refCount = 0;
+
+    //Get rid of old loaded surface
+    SDL_FreeSurface(surface);
+    return &entry;
+}
+
+void LTextureCache::release(Entry* entry)
+{
+    entry->refCount--;
+    if (entry->refCount <= 0)
+    {
+        SDL_DestroyTexture(entry->texture);
+        std::string path = entry->path;
+        entries.erase(path);
+    }
+}
+
+void LTextureCache::clear()
+{
+    for (std::map<std::string, Entry>::iterator it = entries.begin(); it != entries.end(); ++it)
+    {
+        SDL_DestroyTexture(it->second.texture);
+    }
+    entries.clear();
+}
+
+LTexture::LTexture()
+{
+    //Initialize
+    mTexture = NULL;
+    mWidth = 0;
+    mHeight = 0;
+    mCacheEntry = nullptr;
+}
+
+LTexture::~LTexture()
+{
+    //Deallocate
+    free();
+}
+
+bool LTexture::loadFromFile(std::string path)
+{
+    //Get rid of preexisting texture
+    free();
+
+    //Share the texture with every other LTexture loaded from this path
+    mCacheEntry = gTextureCache.acquire(path);
+    if (mCacheEntry == nullptr)
+    {
+        return false;
+    }
+
+    mTexture = mCacheEntry->texture;
+    mWidth = mCacheEntry->width;
+    mHeight = mCacheEntry->height;
+    return true;
+}
+
+bool LTexture::loadFromSurface(SDL_Surface* surface)
+{
+    //Get rid of preexisting texture
+    free();
+
+    if (surface == nullptr)
+    {
+        return false;
+    }
+
+    //Create texture from surface pixels
+    mTexture = SDL_CreateTextureFromSurface(gRenderer, surface);
+    if (mTexture == NULL)
+    {
+        printf("Unable to create texture from surface! SDL Error: %s\n", SDL_GetError());
+    }
+    else
+    {
+        //Get image dimensions
+        mWidth = surface->w;
+        mHeight = surface->h;
+    }
+
+    //Get rid of the decoded surface
+    SDL_FreeSurface(surface);
+    return mTexture != NULL;
+}
+
+void LTexture::free()
+{
+    //Give a shared texture back to the cache instead of destroying it
+    if (mCacheEntry != nullptr)
+    {
+        gTextureCache.release(mCacheEntry);
+        mCacheEntry = nullptr;
+        mTexture = NULL;
+        mWidth = 0;
+        mHeight = 0;
+    }
+
+    //Free texture if it exists
+    if (mTexture != NULL)
+    {
+        SDL_DestroyTexture(mTexture);
+        mTexture = NULL;
+        mWidth = 0;
+        mHeight = 0;
+    }
+}
+
+void LTexture::render1(int x, int y)
+{
+    //Set rendering space and render1 to screen
+    SDL_Rect renderQuad = { x, y, mWidth, mHeight };
+    SDL_RenderCopy(gRenderer, mTexture, NULL, &renderQuad);
+    gDrawCalls++;
+}
+
+void LTexture::render2(int x, int y, int width, int height)
+{
+    //Set rendering space and render1 to screen
+    SDL_Rect renderQuad = { x, y, width, height };
+    SDL_RenderCopy(gRenderer, mTexture, NULL, &renderQuad);
+    gDrawCalls++;
+}
+
+int LTexture::getWidth() const {
+    return mWidth;
+}
+
+int LTexture::getHeight() const {
+    return mHeight;
+}
+
+bool LTexture::loadFromRenderedText(std::string textureText, SDL_Color textColor) {
+    //Get rid of preexisting texture
+    free();
+
     //Render text surface
     SDL_Surface* textSurface = TTF_RenderText_Solid( gFont, textureText.c_str(), textColor );
     if( textSurface == NULL )
@@ -657,6 +1489,349 @@ bool LTexture::loadFromRenderedText(std::string textureText, SDL_Color textColor
     return mTexture != NULL;
 }
 
+LTileAtlas::LTileAtlas()
+{
+    //Initialize
+    mTexture = NULL;
+    mWidth = 0;
+    mHeight = 0;
+}
+
+LTileAtlas::~LTileAtlas()
+{
+    //Deallocate
+    free();
+}
+
+bool LTileAtlas::pack(std::vector<std::string> paths, std::vector<int> sizes)
+{
+    //Get rid of preexisting atlas
+    free();
+
+    bool success = true;
+    int atlasWidth = ATLAS_MIN_WIDTH;
+    tileSizes = sizes;
+    int variants = std::max(1, (int)sizes.size());
+    std::vector<SDL_Surface*> surfaces(paths.size() * variants, nullptr);
+    std::vector<int> order;
+
+    //Decode every image on the worker pool, decodeSurface already applies the color key
+    std::vector<std::future<SDL_Surface*>> decoded;
+    for (int i = 0; i < paths.size(); i++)
+    {
+        decoded.push_back(gLoader.loadSurface(paths[i]));
+    }
+
+    for (int i = 0; i < paths.size(); i++)
+    {
+        SDL_Surface* decodedSurface = decoded[i].get();
+        if (decodedSurface == nullptr)
+        {
+            success = false;
+            continue;
+        }
+
+        //Resample a copy of the tile for every size, the last one takes over the decoded surface
+        for (int v = 0; v < variants; v++)
+        {
+            int slot = i * variants + v;
+            if (sizes.empty())
+            {
+                surfaces[slot] = decodedSurface;
+            }
+            else
+            {
+                SDL_Surface* source = v + 1 < variants ? SDL_DuplicateSurface(decodedSurface) : decodedSurface;
+                surfaces[slot] = scaleSurface(source, sizes[v], sizes[v]);
+            }
+            if (surfaces[slot] == nullptr)
+            {
+                success = false;
+                continue;
+            }
+
+            //Keyed pixels are skipped by the blit and stay transparent in the atlas
+            SDL_SetSurfaceBlendMode(surfaces[slot], SDL_BLENDMODE_NONE);
+
+            atlasWidth = std::max(atlasWidth, surfaces[slot]->w + 2 * ATLAS_PADDING);
+            order.push_back(slot);
+        }
+    }
+
+    //Shelf packing: tallest images first, a new shelf starts when the current one is full
+    std::sort(order.begin(), order.end(), [&surfaces](int a, int b) { return surfaces[a]->h > surfaces[b]->h; });
+    clips.assign(surfaces.size(), SDL_Rect{0, 0, 0, 0});
+    int shelfX = 0;
+    int shelfY = 0;
+    int shelfHeight = 0;
+    for (int i : order)
+    {
+        int w = surfaces[i]->w + 2 * ATLAS_PADDING;
+        int h = surfaces[i]->h + 2 * ATLAS_PADDING;
+        if (shelfX + w > atlasWidth)
+        {
+            shelfX = 0;
+            shelfY += shelfHeight;
+            shelfHeight = 0;
+        }
+        clips[i] = { shelfX + ATLAS_PADDING, shelfY + ATLAS_PADDING, surfaces[i]->w, surfaces[i]->h };
+        shelfX += w;
+        shelfHeight = std::max(shelfHeight, h);
+    }
+
+    //Copy every tile into a single transparent surface
+    if (!order.empty())
+    {
+        SDL_Surface* atlasSurface = SDL_CreateRGBSurfaceWithFormat(0, atlasWidth, shelfY + shelfHeight, 32, SDL_PIXELFORMAT_RGBA32);
+        if (atlasSurface == nullptr)
+        {
+            printf("Unable to create atlas surface! SDL Error: %s\n", SDL_GetError());
+            success = false;
+        }
+        else
+        {
+            for (int i : order)
+            {
+                SDL_Rect destination = clips[i];
+                SDL_BlitSurface(surfaces[i], NULL, atlasSurface, &destination);
+            }
+
+            //Create texture from surface pixels
+            atlasSurface = convertToNativeFormat(atlasSurface, gRendererInfo);
+            mTexture = SDL_CreateTextureFromSurface(gRenderer, atlasSurface);
+            if (mTexture == NULL)
+            {
+                printf("Unable to create atlas texture! SDL Error: %s\n", SDL_GetError());
+                success = false;
+            }
+            else
+            {
+                mWidth = atlasSurface->w;
+                mHeight = atlasSurface->h;
+            }
+            SDL_FreeSurface(atlasSurface);
+        }
+    }
+
+    //Get rid of loaded surfaces
+    for (SDL_Surface* surface : surfaces)
+    {
+        SDL_FreeSurface(surface);
+    }
+
+    return success;
+}
+
+void LTileAtlas::free()
+{
+    //Free texture if it exists
+    if (mTexture != NULL)
+    {
+        SDL_DestroyTexture(mTexture);
+        mTexture = NULL;
+        mWidth = 0;
+        mHeight = 0;
+    }
+    clips.clear();
+    tileSizes.clear();
+}
+
+bool LTileAtlas::reload(int tile, std::string path)
+{
+    int variants = std::max(1, (int)tileSizes.size());
+    if (mTexture == NULL || tile < 0 || (tile + 1) * variants > clips.size())
+    {
+        return false;
+    }
+    SDL_Surface* decodedSurface = decodeSurface(path);
+    if (decodedSurface == nullptr)
+    {
+        return false;
+    }
+
+    //Every copy is resampled to the slot it already has, so no other tile moves
+    Uint32 format;
+    SDL_QueryTexture(mTexture, &format, NULL, NULL, NULL);
+    bool success = true;
+    for (int v = 0; v < variants; v++)
+    {
+        const SDL_Rect& clip = clips[tile * variants + v];
+        SDL_Surface* source = v + 1 < variants ? SDL_DuplicateSurface(decodedSurface) : decodedSurface;
+        SDL_Surface* scaled = scaleSurface(source, clip.w, clip.h);
+        SDL_Surface* converted = scaled == nullptr ? nullptr : SDL_ConvertSurfaceFormat(scaled, format, 0);
+        if (converted == nullptr || SDL_UpdateTexture(mTexture, &clip, converted->pixels, converted->pitch) != 0)
+        {
+            printf("Unable to update atlas tile %s! SDL Error: %s\n", path.c_str(), SDL_GetError());
+            success = false;
+        }
+        SDL_FreeSurface(converted);
+        SDL_FreeSurface(scaled);
+    }
+
+    return success;
+}
+
+const SDL_Rect& LTileAtlas::getClip(int tile, int width, int height) const
+{
+    //Prefer the copy resampled to this size, any other size is scaled from the first one
+    int clip = tile * std::max(1, (int)tileSizes.size());
+    for (int v = 0; v < tileSizes.size(); v++)
+    {
+        if (tileSizes[v] == width && tileSizes[v] == height)
+        {
+            clip += v;
+            break;
+        }
+    }
+    return clips[clip];
+}
+
+void LTileAtlas::render(int tile, int x, int y, int width, int height)
+{
+    //Set rendering space and render the tile's part of the atlas to screen
+    SDL_Rect renderQuad = { x, y, width, height };
+    SDL_RenderCopy(gRenderer, mTexture, &getClip(tile, width, height), &renderQuad);
+    gDrawCalls++;
+}
+
+LGlyphAtlas::LGlyphAtlas()
+{
+    //Initialize
+    mTexture = NULL;
+    mHeight = 0;
+}
+
+LGlyphAtlas::~LGlyphAtlas()
+{
+    //Deallocate
+    free();
+}
+
+bool LGlyphAtlas::build(TTF_Font* font)
+{
+    //Get rid of preexisting atlas
+    free();
+
+    //Rasterize every glyph and lay them out in rows
+    SDL_Color white = { 255, 255, 255, 255 };
+    SDL_Surface* glyphs[GLYPH_COUNT];
+    int x = 0;
+    int y = 0;
+    int rowHeight = 0;
+    mHeight = TTF_FontHeight(font);
+    for (int i = 0; i < GLYPH_COUNT; i++)
+    {
+        int minX, maxX, minY, maxY;
+        if (TTF_GlyphMetrics(font, GLYPH_FIRST + i, &minX, &maxX, &minY, &maxY, &advances[i]) != 0)
+        {
+            advances[i] = 0;
+        }
+        clips[i] = { 0, 0, 0, 0 };
+        glyphs[i] = TTF_RenderGlyph_Blended(font, GLYPH_FIRST + i, white);
+        if (glyphs[i] == nullptr)
+        {
+            continue;
+        }
+
+        if (x + glyphs[i]->w > GLYPH_ATLAS_WIDTH)
+        {
+            x = 0;
+            y += rowHeight + GLYPH_PADDING;
+            rowHeight = 0;
+        }
+        clips[i] = { x, y, glyphs[i]->w, glyphs[i]->h };
+        x += glyphs[i]->w + GLYPH_PADDING;
+        rowHeight = std::max(rowHeight, glyphs[i]->h);
+    }
+
+    //Copy every glyph into a single transparent surface
+    bool success = true;
+    SDL_Surface* atlasSurface = SDL_CreateRGBSurfaceWithFormat(0, GLYPH_ATLAS_WIDTH, y + rowHeight, 32, SDL_PIXELFORMAT_RGBA32);
+    if (atlasSurface == nullptr)
+    {
+        printf("Unable to create glyph atlas surface! SDL Error: %s\n", SDL_GetError());
+        success = false;
+    }
+    else
+    {
+        for (int i = 0; i < GLYPH_COUNT; i++)
+        {
+            if (glyphs[i] != nullptr)
+            {
+                SDL_SetSurfaceBlendMode(glyphs[i], SDL_BLENDMODE_NONE);
+                SDL_BlitSurface(glyphs[i], NULL, atlasSurface, &clips[i]);
+            }
+        }
+
+        //Create texture from surface pixels
+        atlasSurface = convertToNativeFormat(atlasSurface, gRendererInfo);
+        mTexture = SDL_CreateTextureFromSurface(gRenderer, atlasSurface);
+        if (mTexture == NULL)
+        {
+            printf("Unable to create glyph atlas texture! SDL Error: %s\n", SDL_GetError());
+            success = false;
+        }
+        else
+        {
+            SDL_SetTextureBlendMode(mTexture, SDL_BLENDMODE_BLEND);
+        }
+        SDL_FreeSurface(atlasSurface);
+    }
+
+    //Get rid of rasterized glyphs
+    for (SDL_Surface* glyph : glyphs)
+    {
+        SDL_FreeSurface(glyph);
+    }
+
+    return success;
+}
+
+void LGlyphAtlas::free()
+{
+    //Free texture if it exists
+    if (mTexture != NULL)
+    {
+        SDL_DestroyTexture(mTexture);
+        mTexture = NULL;
+        mHeight = 0;
+    }
+}
+
+void LGlyphAtlas::render(const char* text, int x, int y, SDL_Color color)
+{
+    //Tint the white glyphs, the copies below are batched by the renderer
+    SDL_SetTextureColorMod(mTexture, color.r, color.g, color.b);
+    for (const char* c = text; *c != '\0'; c++)
+    {
+        int glyph = (unsigned char)*c - GLYPH_FIRST;
+        if (glyph < 0 || glyph >= GLYPH_COUNT)
+        {
+            continue;
+        }
+
+        //Set rendering space and render the glyph's part of the atlas to screen
+        SDL_Rect renderQuad = { x, y, clips[glyph].w, clips[glyph].h };
+        SDL_RenderCopy(gRenderer, mTexture, &clips[glyph], &renderQuad);
+        gDrawCalls++;
+        x += advances[glyph];
+    }
+}
+
+int LGlyphAtlas::measure(const char* text) const
+{
+    int width = 0;
+    for (const char* c = text; *c != '\0'; c++)
+    {
+        int glyph = (unsigned char)*c - GLYPH_FIRST;
+        if (glyph >= 0 && glyph < GLYPH_COUNT)
+        {
+            width += advances[glyph];
+        }
+    }
+    return width;
+}
+
 Player::Player(float x_pos, float y_pos, int tile_size, std::string tex, KEYVARIANTS keyVar)
 {
     keyVariant = keyVar;
@@ -743,33 +1918,29 @@ void Player::handleEvent(SDL_Event& e)
         //If a key was pressed
         if (e.type == SDL_KEYDOWN && e.key.repeat == 0)
         {
-            SDL_Color textColor = { 255, 255, 255 };
             //Adjust the velocity
             switch (e.key.keysym.sym)
             {
                 case SDLK_o:
-                    FRONTSPEED += 0.1;
-                    paralax1Texture.loadFromRenderedText("First layer: " + std::to_string(FRONTSPEED), textColor);
+                    adjustLayerSpeed(0, 0.1);
                     break;
                 case SDLK_i:
-                    FRONTSPEED -= 0.1;
-                    paralax1Texture.loadFromRenderedText("First layer: " + std::to_string(FRONTSPEED), textColor);
+                    adjustLayerSpeed(0, -0.1);
                     break;
                 case SDLK_l:
-                    BGROUND1SPEED += 0.1;
-                    paralax2Texture.loadFromRenderedText("Second layer: " + std::to_string(BGROUND1SPEED), textColor);
+                    adjustLayerSpeed(1, 0.1);
                     break;
                 case SDLK_k:
-                    BGROUND1SPEED -= 0.1;
-                    paralax2Texture.loadFromRenderedText("Second layer: " + std::to_string(BGROUND1SPEED), textColor);
+                    adjustLayerSpeed(1, -0.1);
                     break;
                 case SDLK_COMMA:
-                    BGROUND2SPEED += 0.1;
-                    paralax3Texture.loadFromRenderedText("Third layer: " + std::to_string(BGROUND2SPEED), textColor);
+                    adjustLayerSpeed(2, 0.1);
                     break;
                 case SDLK_m:
-                    BGROUND2SPEED -= 0.1;
-                    paralax3Texture.loadFromRenderedText("Third layer: " + std::to_string(BGROUND2SPEED), textColor);
+                    adjustLayerSpeed(2, -0.1);
+                    break;
+                case SDLK_g:
+                    gUseGeometry = !gUseGeometry;
                     break;
             }
         }
@@ -846,88 +2017,326 @@ void Player::setPosition(float x, float y) {
     mPosY = y;
 }
 
-Level::Level(Layer layer, float speed) {
+Level::Level(const Layer& layer, float speed) {
     this->speed = speed;
-    std::vector<int> line;
-    availablePositions.clear();
+    load(layer);
+}
+
+void Level::load(const Layer& layer) {
+    for (Wall* w : levelWalls) {
+        delete w;
+    }
+    levelWalls.clear();
+    gridWidth = layer.width;
+    gridHeight = layer.height;
+    tileSize = layer.tileSize;
+    wallRowStart.assign(1, 0);
+    //Only the occupied cells are visited, the empty runs between them cost nothing
     for (int j = 0; j < layer.height; j++) {
-        for (int i = 0; i < layer.width; i++) {
-            switch (layer.mapString[j * layer.width + i])
+        for (const LayerCell* cell = layer.rowBegin(j); cell != layer.rowEnd(j); cell++) {
+            int i = cell->column;
+            switch (cell->tile)
             {
                 case '#':
-                    levelWalls.push_back(new Wall(i * layer.tileSize, j * layer.tileSize, layer.tileSize, layer.tileSize));
-                    levelWalls.back()->texture.loadFromFile("../paralax_assets/ground.png");
-                    line.push_back(UNAVAILABLE);
+                    levelWalls.push_back(new Wall(i * layer.tileSize, j * layer.tileSize, layer.tileSize, layer.tileSize, PARALAX_GROUND));
                     break;
                 case 's':
-                    levelWalls.push_back(new Wall(i * layer.tileSize, j * layer.tileSize, layer.tileSize, layer.tileSize));
-                    levelWalls.back()->texture.loadFromFile("../paralax_assets/sun.png");
+                    levelWalls.push_back(new Wall(i * layer.tileSize, j * layer.tileSize, layer.tileSize, layer.tileSize, PARALAX_SUN));
                     levelWalls.back()->isActive = false;
-                    line.push_back(AVAILABLE);
                     break;
                 case 't':
-                    levelWalls.push_back(new Wall(i * layer.tileSize, j * layer.tileSize, layer.tileSize, layer.tileSize));
-                    levelWalls.back()->texture.loadFromFile("../paralax_assets/tree_tile.png");
+                    levelWalls.push_back(new Wall(i * layer.tileSize, j * layer.tileSize, layer.tileSize, layer.tileSize, PARALAX_TREE));
                     levelWalls.back()->isActive = false;
-                    line.push_back(AVAILABLE);
                     break;
                 case 'T':
-                    levelWalls.push_back(new Wall(i * layer.tileSize, j * layer.tileSize, layer.tileSize, layer.tileSize));
-                    levelWalls.back()->texture.loadFromFile("../paralax_assets/tree_tile.png");
+                    levelWalls.push_back(new Wall(i * layer.tileSize, j * layer.tileSize, layer.tileSize, layer.tileSize, PARALAX_TREE));
                     levelWalls.back()->scale = 2;
                     levelWalls.back()->isActive = false;
-                    line.push_back(AVAILABLE);
                     break;
                 case 'o':
-                    levelWalls.push_back(new Wall(i * layer.tileSize, j * layer.tileSize, layer.tileSize, layer.tileSize));
-                    levelWalls.back()->texture.loadFromFile("../paralax_assets/Rock.png");
+                    levelWalls.push_back(new Wall(i * layer.tileSize, j * layer.tileSize, layer.tileSize, layer.tileSize, PARALAX_ROCK));
                     levelWalls.back()->isActive = false;
-                    line.push_back(AVAILABLE);
                     break;
                 case 'O':
-                    levelWalls.push_back(new Wall(i * layer.tileSize, j * layer.tileSize, layer.tileSize, layer.tileSize));
-                    levelWalls.back()->texture.loadFromFile("../paralax_assets/Rock.png");
+                    levelWalls.push_back(new Wall(i * layer.tileSize, j * layer.tileSize, layer.tileSize, layer.tileSize, PARALAX_ROCK));
                     levelWalls.back()->isActive = false;
                     levelWalls.back()->scale = 2;
-                    line.push_back(AVAILABLE);
                     break;
                 case 'c':
-                    levelWalls.push_back(new Wall(i * layer.tileSize, j * layer.tileSize, layer.tileSize, layer.tileSize));
-                    levelWalls.back()->texture.loadFromFile("../paralax_assets/cloud.png");
+                    levelWalls.push_back(new Wall(i * layer.tileSize, j * layer.tileSize, layer.tileSize, layer.tileSize, PARALAX_CLOUD));
                     levelWalls.back()->isActive = false;
-                    line.push_back(AVAILABLE);
                     break;
                 case 'f':
-                    levelWalls.push_back(new Wall(i * layer.tileSize, j * layer.tileSize, layer.tileSize, layer.tileSize));
-                    levelWalls.back()->texture.loadFromFile("../paralax_assets/flower.png");
+                    levelWalls.push_back(new Wall(i * layer.tileSize, j * layer.tileSize, layer.tileSize, layer.tileSize, PARALAX_FLOWER));
                     levelWalls.back()->scale = 2;
                     levelWalls.back()->isActive = false;
-                    line.push_back(AVAILABLE);
-                    break;
-                default:
-                    line.push_back(AVAILABLE);
                     break;
             }
         }
-        availablePositions.push_back(line);
-        line.clear();
+        wallRowStart.push_back(levelWalls.size());
     }
 }
 
 Level::~Level() {
+    freeStrips();
     for(Wall* w : levelWalls) {
-        w->texture.free();
+        delete w;
     }
 }
 
 void Level::render(float init_x, float init_y) {
+    if (renderStrips(init_x, init_y)) {
+        return;
+    }
+    if (gUseGeometry && renderGeometry(init_x, init_y)) {
+        return;
+    }
+
+    //The part of the layer on screen moves with the camera at the speed of the layer
+    queryWalls(init_x * this->speed, init_y, SCREEN_WIDTH, SCREEN_HEIGHT, visibleWalls);
+    for (Wall* w : visibleWalls) {
+        paralaxAtlas.render(w->tile, w->xp - init_x * this->speed, w->yp - init_y, w->w * w->scale, w->h * w->scale);
+    }
+}
+
+void Level::buildGeometry() {
+    geometry.clear();
+    indices.clear();
+    if (paralaxAtlas.getTexture() == NULL || paralaxAtlas.getWidth() <= 0 || paralaxAtlas.getHeight() <= 0) {
+        return;
+    }
+
+    //Walls are stored row by row, so the quads of a row are next to each other
+    SDL_Color white = { 255, 255, 255, 255 };
+    float atlasWidth = paralaxAtlas.getWidth();
+    float atlasHeight = paralaxAtlas.getHeight();
     for (Wall* w : levelWalls) {
-        w->texture.render2(w->xp - init_x * this->speed, w->yp - init_y, w->w * w->scale, w->h * w->scale);
+        float width = w->w * w->scale;
+        float height = w->h * w->scale;
+        const SDL_Rect& clip = paralaxAtlas.getClip(w->tile, width, height);
+        float u0 = clip.x / atlasWidth;
+        float v0 = clip.y / atlasHeight;
+        float u1 = (clip.x + clip.w) / atlasWidth;
+        float v1 = (clip.y + clip.h) / atlasHeight;
+        int first = geometry.size();
+        geometry.push_back({ { w->xp, w->yp }, white, { u0, v0 } });
+        geometry.push_back({ { w->xp + width, w->yp }, white, { u1, v0 } });
+        geometry.push_back({ { w->xp, w->yp + height }, white, { u0, v1 } });
+        geometry.push_back({ { w->xp + width, w->yp + height }, white, { u1, v1 } });
+        int quad[6] = { first, first + 1, first + 2, first + 2, first + 1, first + 3 };
+        indices.insert(indices.end(), quad, quad + 6);
+    }
+}
+
+bool Level::renderGeometry(float init_x, float init_y) {
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    if (geometry.size() != levelWalls.size() * 4) {
+        return false;
+    }
+
+    //Tiles on screen, one more above and to the left for the tiles scaled by 2 that reach into it
+    float originX = init_x * this->speed;
+    int firstColumn = std::max(0, (int)std::floor(originX / tileSize) - (MAX_WALL_SCALE - 1));
+    int lastColumn = std::min(gridWidth - 1, (int)std::floor((originX + SCREEN_WIDTH) / tileSize));
+    int firstRow = std::max(0, (int)std::floor(init_y / tileSize) - (MAX_WALL_SCALE - 1));
+    int lastRow = std::min(gridHeight - 1, (int)std::floor((init_y + SCREEN_HEIGHT) / tileSize));
+    if (firstColumn > lastColumn || firstRow > lastRow) {
+        return true;
+    }
+
+    //The camera moves the quads by whole pixels, the same as the copies land on. The quads of the columns on screen
+    //are next to each other within a row, and the index range starting at 0 fits any run of them packed into translated
+    float dx = std::floor(-originX);
+    float dy = std::floor(-init_y);
+    translated.clear();
+    for (int j = firstRow; j <= lastRow; j++) {
+        int first = firstWallFrom(j, firstColumn);
+        int last = firstWallFrom(j, lastColumn + 1);
+        translated.insert(translated.end(), geometry.begin() + first * 4, geometry.begin() + last * 4);
+    }
+    if (translated.empty()) {
+        return true;
+    }
+    int quads = translated.size() / 4;
+    for (SDL_Vertex& vertex : translated) {
+        vertex.position.x += dx;
+        vertex.position.y += dy;
+    }
+    if (SDL_RenderGeometry(gRenderer, paralaxAtlas.getTexture(), translated.data(), translated.size(), indices.data(), quads * 6) != 0) {
+        return false;
+    }
+    gDrawCalls++;
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool Level::resetStrips() {
+    freeStrips();
+    SDL_RendererInfo info;
+    if (paralaxAtlas.getTexture() == NULL || SDL_GetRendererInfo(gRenderer, &info) != 0 ||
+        !(info.flags & SDL_RENDERER_TARGETTEXTURE)) {
+        return false;
+    }
+
+    //Nothing is rendered yet, a layer far larger than the screen only ever holds the pieces around the screen
+    stripColumns = (gridWidth * tileSize + LAYER_STRIP_SIZE - 1) / LAYER_STRIP_SIZE;
+    stripRows = (gridHeight * tileSize + LAYER_STRIP_SIZE - 1) / LAYER_STRIP_SIZE;
+    strips.assign(size_t(stripColumns) * stripRows, nullptr);
+    stripBuilt.assign(strips.size(), false);
+    return true;
+}
+
+bool Level::buildStrip(int column, int row) {
+    size_t piece = size_t(row) * stripColumns + column;
+    stripBuilt[piece] = true;
+    builtStrips.push_back(piece);
+    int x = column * LAYER_STRIP_SIZE;
+    int y = row * LAYER_STRIP_SIZE;
+    int w = std::min(LAYER_STRIP_SIZE, gridWidth * tileSize - x);
+    int h = std::min(LAYER_STRIP_SIZE, gridHeight * tileSize - y);
+    queryWalls(x, y, w, h, visibleWalls);
+    if (visibleWalls.empty()) {
+        return true;
+    }
+
+    SDL_Texture* previousTarget = SDL_GetRenderTarget(gRenderer);
+    SDL_Texture* strip = SDL_CreateTexture(gRenderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, w, h);
+    if (strip == NULL || SDL_SetRenderTarget(gRenderer, strip) != 0) {
+        printf("Unable to pre-render layer piece! SDL Error: %s\n", SDL_GetError());
+        SDL_DestroyTexture(strip);
+        return false;
+    }
+
+    //The tiles are blended onto a transparent piece, which leaves their colors multiplied by alpha, so the piece
+    //is drawn premultiplied where the renderer can; the colour keyed tiles look the same either way
+    SDL_BlendMode premultiplied = SDL_ComposeCustomBlendMode(SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_ONE_MINUS_SRC_ALPHA, SDL_BLENDOPERATION_ADD,
+                                                             SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_ONE_MINUS_SRC_ALPHA, SDL_BLENDOPERATION_ADD);
+    if (SDL_SetTextureBlendMode(strip, premultiplied) != 0) {
+        SDL_SetTextureBlendMode(strip, SDL_BLENDMODE_BLEND);
+    }
+    Uint8 r, g, b, a;
+    SDL_GetRenderDrawColor(gRenderer, &r, &g, &b, &a);
+    SDL_SetRenderDrawColor(gRenderer, 0, 0, 0, 0);
+    SDL_RenderClear(gRenderer);
+    for (Wall* wall : visibleWalls) {
+        paralaxAtlas.render(wall->tile, wall->xp - x, wall->yp - y, wall->w * wall->scale, wall->h * wall->scale);
+    }
+    SDL_SetRenderTarget(gRenderer, previousTarget);
+    SDL_SetRenderDrawColor(gRenderer, r, g, b, a);
+    strips[piece] = strip;
+    return true;
+}
+
+void Level::freeStrips() {
+    for (SDL_Texture* strip : strips) {
+        SDL_DestroyTexture(strip);
     }
+    strips.clear();
+    stripBuilt.clear();
+    builtStrips.clear();
+    stripColumns = 0;
+    stripRows = 0;
 }
 
-std::vector<std::vector<int>> Level::getAvailablePositions() {
-    return availablePositions;
+bool Level::renderStrips(float init_x, float init_y) {
+    if (strips.empty()) {
+        return false;
+    }
+
+    //Only the one or two pieces under the screen in each direction are copied, however large the layer is
+    int originX = (int)std::floor(init_x * this->speed);
+    int originY = (int)std::floor(init_y);
+    int firstColumn = std::max(0, (int)std::floor((float)originX / LAYER_STRIP_SIZE));
+    int lastColumn = std::min(stripColumns - 1, (int)std::floor((float)(originX + SCREEN_WIDTH - 1) / LAYER_STRIP_SIZE));
+    int firstRow = std::max(0, (int)std::floor((float)originY / LAYER_STRIP_SIZE));
+    int lastRow = std::min(stripRows - 1, (int)std::floor((float)(originY + SCREEN_HEIGHT - 1) / LAYER_STRIP_SIZE));
+
+    //Pieces more than a screen off view are freed, and at least a piece off, so the pieces built ahead below stay
+    int keepX = std::max(SCREEN_WIDTH, LAYER_STRIP_SIZE);
+    int keepY = std::max(SCREEN_HEIGHT, LAYER_STRIP_SIZE);
+    for (size_t i = 0; i < builtStrips.size();) {
+        size_t piece = builtStrips[i];
+        int x = int(piece % stripColumns) * LAYER_STRIP_SIZE;
+        int y = int(piece / stripColumns) * LAYER_STRIP_SIZE;
+        if (x + LAYER_STRIP_SIZE > originX - keepX && x < originX + SCREEN_WIDTH + keepX &&
+            y + LAYER_STRIP_SIZE > originY - keepY && y < originY + SCREEN_HEIGHT + keepY) {
+            i++;
+            continue;
+        }
+        SDL_DestroyTexture(strips[piece]);
+        strips[piece] = nullptr;
+        stripBuilt[piece] = false;
+        builtStrips[i] = builtStrips.back();
+        builtStrips.pop_back();
+    }
+
+    for (int row = firstRow; row <= lastRow; row++) {
+        for (int column = firstColumn; column <= lastColumn; column++) {
+            //Pieces on screen are normally built ahead, only after a reset or a jump of the camera are they built
+            //here. A piece the renderer can't build leaves the layer to be drawn tile by tile
+            if (!stripBuilt[size_t(row) * stripColumns + column] && !buildStrip(column, row)) {
+                freeStrips();
+                return false;
+            }
+            SDL_Texture* strip = strips[size_t(row) * stripColumns + column];
+            if (strip == NULL) {
+                continue;
+            }
+            SDL_Rect renderQuad = { column * LAYER_STRIP_SIZE - originX, row * LAYER_STRIP_SIZE - originY,
+                                    std::min(LAYER_STRIP_SIZE, gridWidth * tileSize - column * LAYER_STRIP_SIZE),
+                                    std::min(LAYER_STRIP_SIZE, gridHeight * tileSize - row * LAYER_STRIP_SIZE) };
+            SDL_RenderCopy(gRenderer, strip, NULL, &renderQuad);
+            gDrawCalls++;
+        }
+    }
+
+    //The pieces one past each edge of the screen are rendered a few a frame, so scrolling onto them costs nothing
+    int aheadLastColumn = std::min(stripColumns - 1, lastColumn + 1);
+    int aheadLastRow = std::min(stripRows - 1, lastRow + 1);
+    int builds = 0;
+    for (int row = std::max(0, firstRow - 1); row <= aheadLastRow; row++) {
+        for (int column = std::max(0, firstColumn - 1); column <= aheadLastColumn; column++) {
+            if (stripBuilt[size_t(row) * stripColumns + column]) {
+                continue;
+            }
+            if (builds++ == LAYER_STRIP_BUILDS_PER_FRAME) {
+                return true;
+            }
+            if (!buildStrip(column, row)) {
+                freeStrips();
+                return true;
+            }
+        }
+    }
+    return true;
+}
+
+int Level::firstWallFrom(int row, int column) const {
+    std::vector<Wall*>::const_iterator begin = levelWalls.begin() + wallRowStart[row];
+    std::vector<Wall*>::const_iterator end = levelWalls.begin() + wallRowStart[row + 1];
+    return std::lower_bound(begin, end, column, [this](const Wall* w, int column) { return (int)(w->xp / tileSize) < column; }) -
+           levelWalls.begin();
+}
+
+void Level::queryWalls(float x, float y, float w, float h, std::vector<Wall*>& walls) {
+    //Only the rows under the rectangle are visited, and the tiles a scaled wall reaching into it starts in.
+    //Within a row the columns are found by binary search, the empty runs between walls cost nothing
+    walls.clear();
+    if (tileSize <= 0) {
+        return;
+    }
+    int firstColumn = std::max(0, (int)std::floor(x / tileSize) - (MAX_WALL_SCALE - 1));
+    int lastColumn = std::min(gridWidth - 1, (int)std::floor((x + w) / tileSize));
+    int firstRow = std::max(0, (int)std::floor(y / tileSize) - (MAX_WALL_SCALE - 1));
+    int lastRow = std::min(gridHeight - 1, (int)std::floor((y + h) / tileSize));
+    if (firstColumn > lastColumn) {
+        return;
+    }
+    for (int j = firstRow; j <= lastRow; j++) {
+        walls.insert(walls.end(), levelWalls.begin() + firstWallFrom(j, firstColumn), levelWalls.begin() + firstWallFrom(j, lastColumn + 1));
+    }
 }
 
 double distanceSquared( float x1, float y1, float x2, float y2 )
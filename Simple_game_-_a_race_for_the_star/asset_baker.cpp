@@ -0,0 +1,166 @@
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+#include "baked_texture.h"
+
+//Converts PNG assets into pre-decoded, pre-color-keyed textures the game uploads without decoding.
+//Usage: asset_baker [--rle] <source dir> <output dir> <image>...
+//Every image path is relative to the source dir, "level/floor.png" is written to "<output dir>/level/floor.tex"
+
+//The pixel layout the renderers prefer, baked textures are uploaded as they are
+const Uint32 BAKED_FORMAT = SDL_PIXELFORMAT_ARGB8888;
+
+//Color key used by LTexture, opaque in BAKED_FORMAT
+const Uint32 COLOR_KEY = 0xFFFF1117;
+
+void makeDirectories(std::string path);
+bool bakeTexture(std::string source, std::string output, bool rle, size_t& rawBytes, size_t& writtenBytes);
+
+int main(int argc, char* args[])
+{
+    bool rle = false;
+    int first = 1;
+    if (argc > 1 && std::strcmp(args[1], "--rle") == 0)
+    {
+        rle = true;
+        first++;
+    }
+
+    if (argc - first < 3)
+    {
+        printf("Usage: asset_baker [--rle] <source dir> <output dir> <image>...\n");
+        return 1;
+    }
+
+    std::string sourceDir = args[first];
+    std::string outputDir = args[first + 1];
+
+    //Initialize PNG loading
+    int imgFlags = IMG_INIT_PNG;
+    if (!(IMG_Init(imgFlags) & imgFlags))
+    {
+        printf("SDL_image could not initialize! SDL_image Error: %s\n", IMG_GetError());
+        return 1;
+    }
+
+    int baked = 0;
+    int failed = 0;
+    size_t rawBytes = 0;
+    size_t writtenBytes = 0;
+    for (int i = first + 2; i < argc; i++)
+    {
+        std::string image = args[i];
+        std::string output = outputDir + "/" + image.substr(0, image.rfind('.')) + ".tex";
+        if (bakeTexture(sourceDir + "/" + image, output, rle, rawBytes, writtenBytes))
+        {
+            baked++;
+        }
+        else
+        {
+            failed++;
+        }
+    }
+
+    printf("Baked %d textures (%d failed): %zu bytes of pixels written as %zu bytes\n", baked, failed, rawBytes, writtenBytes);
+
+    IMG_Quit();
+    return failed == 0 ? 0 : 1;
+}
+
+void makeDirectories(std::string path)
+{
+    //Create every missing parent directory of path
+    for (size_t slash = path.find('/', 1); slash != std::string::npos; slash = path.find('/', slash + 1))
+    {
+        std::string directory = path.substr(0, slash);
+#ifdef _WIN32
+        _mkdir(directory.c_str());
+#else
+        mkdir(directory.c_str(), 0755);
+#endif
+    }
+}
+
+bool bakeTexture(std::string source, std::string output, bool rle, size_t& rawBytes, size_t& writtenBytes)
+{
+    //Load image at specified path
+    SDL_Surface* loadedSurface = IMG_Load(source.c_str());
+    if (loadedSurface == nullptr)
+    {
+        printf("Unable to load image %s! SDL_image Error: %s\n", source.c_str(), IMG_GetError());
+        return false;
+    }
+
+    //Convert to the layout the game uploads
+    SDL_Surface* converted = SDL_ConvertSurfaceFormat(loadedSurface, BAKED_FORMAT, 0);
+    SDL_FreeSurface(loadedSurface);
+    if (converted == nullptr)
+    {
+        printf("Unable to convert %s! SDL Error: %s\n", source.c_str(), SDL_GetError());
+        return false;
+    }
+
+    //Copy tightly packed rows, turning color keyed pixels fully transparent
+    std::vector<Uint32> pixels(converted->w * converted->h);
+    SDL_LockSurface(converted);
+    for (int y = 0; y < converted->h; y++)
+    {
+        const Uint32* row = (const Uint32*)((const Uint8*)converted->pixels + y * converted->pitch);
+        for (int x = 0; x < converted->w; x++)
+        {
+            pixels[y * converted->w + x] = row[x] == COLOR_KEY ? 0 : row[x];
+        }
+    }
+    SDL_UnlockSurface(converted);
+
+    BakedTextureHeader header;
+    std::memcpy(header.magic, BAKED_TEXTURE_MAGIC, sizeof(header.magic));
+    header.version = BAKED_TEXTURE_VERSION;
+    header.width = converted->w;
+    header.height = converted->h;
+    header.format = BAKED_FORMAT;
+    header.flags = 0;
+    SDL_FreeSurface(converted);
+
+    //Keep the compressed pixels only when they are actually smaller
+    std::vector<Uint32> data;
+    if (rle)
+    {
+        data = bakedEncodeRLE(pixels);
+    }
+    if (rle && data.size() < pixels.size())
+    {
+        header.flags |= BAKED_TEXTURE_RLE;
+    }
+    else
+    {
+        data.swap(pixels);
+        pixels.clear();
+    }
+    header.dataSize = data.size() * sizeof(Uint32);
+
+    makeDirectories(output);
+    FILE* file = fopen(output.c_str(), "wb");
+    if (file == nullptr)
+    {
+        printf("Unable to write %s!\n", output.c_str());
+        return false;
+    }
+    bool success = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   (data.empty() || fwrite(data.data(), header.dataSize, 1, file) == 1);
+    fclose(file);
+
+    rawBytes += header.width * header.height * sizeof(Uint32);
+    writtenBytes += sizeof(header) + header.dataSize;
+    printf("%s -> %s (%ux%u%s)\n", source.c_str(), output.c_str(), header.width, header.height,
+           (header.flags & BAKED_TEXTURE_RLE) ? ", rle" : "");
+    return success;
+}
@@ -0,0 +1,82 @@
+#ifndef BAKED_TEXTURE_H
+#define BAKED_TEXTURE_H
+
+#include <SDL2/SDL.h>
+#include <vector>
+
+//Written in front of the pixels of every baked texture
+struct BakedTextureHeader
+{
+    char magic[4];
+    Uint32 version;
+    Uint32 width;
+    Uint32 height;
+    Uint32 format;
+    Uint32 flags;
+    Uint32 dataSize;
+};
+
+const char BAKED_TEXTURE_MAGIC[4] = { 'B', 'T', 'E', 'X' };
+const Uint32 BAKED_TEXTURE_VERSION = 1;
+const Uint32 BAKED_TEXTURE_RLE = 0x1;
+const Uint32 BAKED_RLE_RUN = 0x80000000;
+
+//Packs pixels into packets: a count word with BAKED_RLE_RUN set is followed by one pixel repeated count times,
+//otherwise count literal pixels follow
+inline std::vector<Uint32> bakedEncodeRLE(const std::vector<Uint32>& pixels)
+{
+    std::vector<Uint32> packed;
+    size_t i = 0;
+    while (i < pixels.size())
+    {
+        size_t run = 1;
+        while (i + run < pixels.size() && pixels[i + run] == pixels[i] && run < 0x7FFFFFFF) { run++; }
+
+        if (run >= 3)
+        {
+            packed.push_back(BAKED_RLE_RUN | Uint32(run));
+            packed.push_back(pixels[i]);
+            i += run;
+        }
+        else
+        {
+            //Collect literals until the next run of at least three pixels
+            size_t start = i;
+            while (i < pixels.size() &&
+                   !(i + 2 < pixels.size() && pixels[i] == pixels[i + 1] && pixels[i] == pixels[i + 2]))
+            {
+                i++;
+            }
+            packed.push_back(Uint32(i - start));
+            packed.insert(packed.end(), pixels.begin() + start, pixels.begin() + i);
+        }
+    }
+    return packed;
+}
+
+//Expands packets written by bakedEncodeRLE, fails on truncated or oversized data
+inline bool bakedDecodeRLE(const std::vector<Uint32>& packed, size_t pixelCount, std::vector<Uint32>& pixels)
+{
+    pixels.clear();
+    pixels.reserve(pixelCount);
+    size_t i = 0;
+    while (i < packed.size())
+    {
+        Uint32 count = packed[i] & ~BAKED_RLE_RUN;
+        if (packed[i] & BAKED_RLE_RUN)
+        {
+            if (i + 1 >= packed.size() || pixels.size() + count > pixelCount) { return false; }
+            pixels.insert(pixels.end(), count, packed[i + 1]);
+            i += 2;
+        }
+        else
+        {
+            if (i + 1 + count > packed.size() || pixels.size() + count > pixelCount) { return false; }
+            pixels.insert(pixels.end(), packed.begin() + i + 1, packed.begin() + i + 1 + count);
+            i += 1 + count;
+        }
+    }
+    return pixels.size() == pixelCount;
+}
+
+#endif
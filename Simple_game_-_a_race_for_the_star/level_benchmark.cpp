@@ -0,0 +1,245 @@
+#include <SDL2/SDL.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "level_format.h"
+#include "mapped_file.h"
+
+//Measures how fast square level maps load: the getline loop the game used before, the single pass parser
+//over one bulk read, the same parse split over every core, and a compiled level mapped the way the game maps it.
+//The game only touches the pages of the chunks around the camera, the mapped, read column reads every page of the mapping.
+//The speedup is the single pass parse time over the parallel one, the bulk read before both is left out of it.
+//Usage: level_benchmark [size]...
+//Maps of 1000, 10000 and 50000 tiles a side are generated when no size is given. They are written to the
+//current directory and deleted afterwards, the largest needs about 5 GB of memory and disk
+
+bool generateMap(std::string textPath, std::string compiledPath, int size);
+bool readWhole(std::string path, std::string& contents);
+double loadGetline(std::string path, int& width, int& height);
+double loadSinglePass(std::string path, int& width, int& height, double& parseSeconds);
+double loadParallel(std::string path, int& width, int& height, double& parseSeconds);
+double loadCompiled(std::string path, int& width, int& height, bool readEveryPage);
+
+int main(int argc, char* args[])
+{
+    std::vector<int> sizes;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::atoi(args[i]) <= 0)
+        {
+            printf("Usage: level_benchmark [size]...\n");
+            return 1;
+        }
+        sizes.push_back(std::atoi(args[i]));
+    }
+    if (sizes.empty())
+    {
+        sizes = { 1000, 10000, 50000 };
+    }
+
+    printf("%-14s %10s %16s %16s %16s %16s %16s %10s\n", "map", "text MB", "getline", "single pass", "parallel", "mapped", "mapped, read", "speedup");
+    for (int size : sizes)
+    {
+        std::string textPath = "level_benchmark_" + std::to_string(size) + ".txt";
+        std::string compiledPath = compiledLevelPath(textPath);
+        if (!generateMap(textPath, compiledPath, size))
+        {
+            std::remove(textPath.c_str());
+            std::remove(compiledPath.c_str());
+            continue;
+        }
+
+        //Every loader must produce the same grid
+        double megabytes = (double(size) + 1) * size / (1024.0 * 1024.0);
+        int width[5] = {};
+        int height[5] = {};
+        double singlePassParse = 0.0;
+        double parallelParse = 0.0;
+        double seconds[5] = {
+                loadGetline(textPath, width[0], height[0]),
+                loadSinglePass(textPath, width[1], height[1], singlePassParse),
+                loadParallel(textPath, width[2], height[2], parallelParse),
+                loadCompiled(compiledPath, width[3], height[3], false),
+                loadCompiled(compiledPath, width[4], height[4], true)
+        };
+        char name[32];
+        snprintf(name, sizeof(name), "%dx%d", size, size);
+        printf("%-14s %10.1f", name, megabytes);
+        for (int i = 0; i < 5; i++)
+        {
+            if (seconds[i] < 0.0 || width[i] != size || height[i] != size)
+            {
+                printf(" %16s", "failed");
+            }
+            else
+            {
+                printf(" %11.1f MB/s", megabytes / seconds[i]);
+            }
+        }
+        if (seconds[1] < 0.0 || seconds[2] < 0.0 || parallelParse <= 0.0)
+        {
+            printf(" %10s\n", "-");
+        }
+        else
+        {
+            printf(" %9.2fx\n", singlePassParse / parallelParse);
+        }
+
+        std::remove(textPath.c_str());
+        std::remove(compiledPath.c_str());
+    }
+    printf("Text megabytes loaded per second, parallel on %u threads, the mapped columns load the same tiles without the newlines.\n"
+           "Speedup is the parallel parse against the single pass, without the read\n",
+           std::max(1u, std::thread::hardware_concurrency()));
+    return 0;
+}
+
+bool generateMap(std::string textPath, std::string compiledPath, int size)
+{
+    FILE* text = fopen(textPath.c_str(), "wb");
+    FILE* compiled = fopen(compiledPath.c_str(), "wb");
+    if (text == nullptr || compiled == nullptr)
+    {
+        printf("Unable to write %s!\n", text == nullptr ? textPath.c_str() : compiledPath.c_str());
+        if (text != nullptr) fclose(text);
+        if (compiled != nullptr) fclose(compiled);
+        return false;
+    }
+
+    LevelFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, LEVEL_FILE_MAGIC, sizeof(header.magic));
+    header.version = LEVEL_FILE_VERSION;
+    header.width = size;
+    header.height = size;
+    header.tileSize = 128;
+    header.layerCount = 1;
+    bool success = fwrite(&header, sizeof(header), 1, compiled) == 1;
+
+    //Walls around the border, scattered walls inside and the star in the middle, written a row at a time
+    std::vector<char> row(size + 1);
+    srand(size);
+    for (int j = 0; success && j < size; j++)
+    {
+        for (int i = 0; i < size; i++)
+        {
+            bool border = i == 0 || j == 0 || i == size - 1 || j == size - 1;
+            row[i] = border || rand() % 8 == 0 ? '#' : LEVEL_EMPTY_TILE;
+        }
+        if (j == size / 2 && size > 2)
+        {
+            row[size / 2] = 'o';
+        }
+        row[size] = '\n';
+        success = fwrite(row.data(), size, 1, compiled) == 1 &&
+                  fwrite(row.data(), j + 1 < size ? size + 1 : size, 1, text) == 1;
+    }
+
+    success = fclose(text) == 0 && success;
+    success = fclose(compiled) == 0 && success;
+    if (!success)
+    {
+        printf("Unable to write the %dx%d map, is the disk full?\n", size, size);
+    }
+    return success;
+}
+
+bool readWhole(std::string path, std::string& contents)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    contents.assign(std::max(size, 0L), '\0');
+    bool success = contents.empty() || fread(&contents[0], contents.size(), 1, file) == 1;
+    fclose(file);
+    return success;
+}
+
+double loadGetline(std::string path, int& width, int& height)
+{
+    //The loop readLevelMap used to run, the string grows one row at a time
+    Uint64 start = SDL_GetPerformanceCounter();
+    std::ifstream file(path);
+    if (!file.good())
+    {
+        return -1.0;
+    }
+    std::string tiles;
+    std::string line;
+    height = 0;
+    while (!file.eof())
+    {
+        height++;
+        std::getline(file, line);
+        tiles += line;
+    }
+    width = line.size();
+    return double(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+}
+
+double loadSinglePass(std::string path, int& width, int& height, double& parseSeconds)
+{
+    Uint64 start = SDL_GetPerformanceCounter();
+    std::string text;
+    std::string tiles;
+    if (!readWhole(path, text))
+    {
+        return -1.0;
+    }
+    Uint64 parseStart = SDL_GetPerformanceCounter();
+    parseTextLevel(text.data(), text.size(), tiles, width, height);
+    Uint64 now = SDL_GetPerformanceCounter();
+    parseSeconds = double(now - parseStart) / SDL_GetPerformanceFrequency();
+    return double(now - start) / SDL_GetPerformanceFrequency();
+}
+
+double loadParallel(std::string path, int& width, int& height, double& parseSeconds)
+{
+    Uint64 start = SDL_GetPerformanceCounter();
+    std::string text;
+    std::string tiles;
+    if (!readWhole(path, text))
+    {
+        return -1.0;
+    }
+    Uint64 parseStart = SDL_GetPerformanceCounter();
+    parseTextLevelParallel(text.data(), text.size(), tiles, width, height);
+    Uint64 now = SDL_GetPerformanceCounter();
+    parseSeconds = double(now - parseStart) / SDL_GetPerformanceFrequency();
+    return double(now - start) / SDL_GetPerformanceFrequency();
+}
+
+double loadCompiled(std::string path, int& width, int& height, bool readEveryPage)
+{
+    //readCompiledLevelMap: map the file and check the header, the tiles are used in place
+    Uint64 start = SDL_GetPerformanceCounter();
+    LMappedFile file;
+    if (!file.open(path))
+    {
+        return -1.0;
+    }
+    const char* tiles = compiledLevelTiles(file.getData(), file.getSize(), width, height);
+    if (tiles == nullptr)
+    {
+        return -1.0;
+    }
+    if (readEveryPage)
+    {
+        //What a camera visiting the whole map would fault in eventually
+        volatile char sum = 0;
+        for (size_t i = 0; i < size_t(width) * height; i += 4096)
+        {
+            sum += tiles[i];
+        }
+    }
+    return double(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+}
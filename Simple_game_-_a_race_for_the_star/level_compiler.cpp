@@ -0,0 +1,134 @@
+#include <SDL2/SDL.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#endif
+#include "level_format.h"
+
+//Compiles text level maps into the binary format the game maps into memory.
+//Usage: level_compiler <tile size> <output> <layer.txt>...
+//Every text file becomes one layer, layers narrower or shorter than the widest one are padded with empty tiles.
+//The level is written next to the output and renamed over it, a running game keeps reading the mapping of the old file
+
+bool readFile(std::string path, std::string& contents);
+bool replaceFile(std::string from, std::string to);
+
+int main(int argc, char* args[])
+{
+    if (argc < 4 || std::atoi(args[1]) < 0)
+    {
+        printf("Usage: level_compiler <tile size> <output> <layer.txt>...\n");
+        return 1;
+    }
+
+    std::string output = args[2];
+    std::vector<std::string> layers;
+    std::vector<int> widths;
+    std::vector<int> heights;
+    int width = 0;
+    int height = 0;
+    for (int i = 3; i < argc; i++)
+    {
+        std::string text;
+        if (!readFile(args[i], text))
+        {
+            return 1;
+        }
+        layers.push_back(std::string());
+        widths.push_back(0);
+        heights.push_back(0);
+        if (!parseTextLevelParallel(text.data(), text.size(), layers.back(), widths.back(), heights.back()))
+        {
+            printf("Warning: rows of %s differ in length, short rows are padded with empty tiles\n", args[i]);
+        }
+        width = std::max(width, widths.back());
+        height = std::max(height, heights.back());
+    }
+
+    LevelFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, LEVEL_FILE_MAGIC, sizeof(header.magic));
+    header.version = LEVEL_FILE_VERSION;
+    header.width = width;
+    header.height = height;
+    header.tileSize = std::atoi(args[1]);
+    header.layerCount = layers.size();
+
+    std::string temporary = output + ".tmp";
+    FILE* file = fopen(temporary.c_str(), "wb");
+    if (file == nullptr)
+    {
+        printf("Unable to write %s!\n", temporary.c_str());
+        return 1;
+    }
+    bool success = fwrite(&header, sizeof(header), 1, file) == 1;
+    std::vector<char> row(width);
+    for (int l = 0; success && l < layers.size(); l++)
+    {
+        for (int j = 0; success && j < height; j++)
+        {
+            //Pad every layer to the size of the level
+            std::fill(row.begin(), row.end(), LEVEL_EMPTY_TILE);
+            if (j < heights[l])
+            {
+                std::memcpy(row.data(), &layers[l][size_t(j) * widths[l]], widths[l]);
+            }
+            success = row.empty() || fwrite(row.data(), row.size(), 1, file) == 1;
+        }
+    }
+    if (fclose(file) != 0)
+    {
+        success = false;
+    }
+
+    if (!success || !replaceFile(temporary, output))
+    {
+        printf("Unable to write %s!\n", output.c_str());
+        std::remove(temporary.c_str());
+        return 1;
+    }
+
+    printf("Compiled %s: %dx%d, %d layers\n", output.c_str(), width, height, (int)layers.size());
+    return 0;
+}
+
+bool readFile(std::string path, std::string& contents)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr)
+    {
+        printf("Unable to open %s!\n", path.c_str());
+        return false;
+    }
+
+    char buffer[4096];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        contents.append(buffer, count);
+    }
+    bool success = ferror(file) == 0;
+    fclose(file);
+
+    if (!success)
+    {
+        printf("Unable to read %s!\n", path.c_str());
+    }
+    return success;
+}
+
+bool replaceFile(std::string from, std::string to)
+{
+#ifdef _WIN32
+    //Fails while a running game has the old level mapped, Windows doesn't replace files in use
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
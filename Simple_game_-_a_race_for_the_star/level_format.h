@@ -0,0 +1,273 @@
+#ifndef LEVEL_FORMAT_H
+#define LEVEL_FORMAT_H
+
+#include <SDL2/SDL.h>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <climits>
+
+//Layout of a compiled level: LevelFileHeader, then layerCount tile arrays of width x height bytes, row by row.
+//Tile codes are the characters of the text maps ('#', 'o', '-'), so the game uses them without translating
+struct LevelFileHeader
+{
+    char magic[4];
+    Uint32 version;
+    Uint32 width;
+    Uint32 height;
+    Uint32 tileSize;
+    Uint32 layerCount;
+    Uint32 reserved[2];
+};
+
+const char LEVEL_FILE_MAGIC[4] = { 'L', 'V', 'L', 'M' };
+const Uint32 LEVEL_FILE_VERSION = 1;
+const char LEVEL_EMPTY_TILE = '-';
+
+//Text maps smaller than this are parsed on the calling thread, starting threads costs more than it saves
+const size_t LEVEL_PARALLEL_PARSE_MIN_BYTES = 4 * 1024 * 1024;
+
+//Compiled levels sit next to the text maps, "../level_map_1.txt" compiles to "../level_map_1.lvl"
+inline std::string compiledLevelPath(std::string textPath)
+{
+    size_t dot = textPath.find_last_of('.');
+    size_t slash = textPath.find_last_of('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    {
+        return textPath + ".lvl";
+    }
+    return textPath.substr(0, dot) + ".lvl";
+}
+
+//The tiles of the first layer of the compiled level in data, used in place. nullptr when the header is wrong
+//or the file is shorter than the header says
+inline const char* compiledLevelTiles(const char* data, size_t size, int& width, int& height)
+{
+    const LevelFileHeader* header = (const LevelFileHeader*)data;
+    if (data == nullptr || size < sizeof(LevelFileHeader) ||
+        std::memcmp(header->magic, LEVEL_FILE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != LEVEL_FILE_VERSION || header->layerCount == 0 || header->width == 0 || header->height == 0 ||
+        header->width > INT_MAX || header->height > INT_MAX ||
+        (size - sizeof(LevelFileHeader)) / header->layerCount < Uint64(header->width) * header->height)
+    {
+        return nullptr;
+    }
+    width = header->width;
+    height = header->height;
+    return data + sizeof(LevelFileHeader);
+}
+
+//Parses a text map into width x height tile codes in a single pass. The first row sets the width and the grid is
+//allocated once for as many rows as the text can hold. Carriage returns and empty lines at the end are ignored,
+//a short row is padded with empty tiles and a longer one widens the grid, so a ragged line never shifts the rows
+//below it. Returns false when the rows were not all the same length
+inline bool parseTextLevel(const char* data, size_t size, std::string& tiles, int& width, int& height)
+{
+    tiles.clear();
+    width = 0;
+    height = 0;
+    bool uniform = true;
+    int emptyRows = 0;
+    const char* end = data + size;
+    for (const char* line = data; line < end; )
+    {
+        const char* newline = (const char*)std::memchr(line, '\n', end - line);
+        const char* next = newline != nullptr ? newline + 1 : end;
+        int length = (newline != nullptr ? newline : end) - line;
+        if (length > 0 && line[length - 1] == '\r')
+        {
+            length--;
+        }
+
+        //Empty rows only count once a row with tiles follows them
+        if (length == 0)
+        {
+            emptyRows++;
+            line = next;
+            continue;
+        }
+        if (width == 0)
+        {
+            width = length;
+            tiles.reserve(size_t(width) * (size / (width + 1) + 1));
+        }
+        for (; emptyRows > 0; emptyRows--)
+        {
+            tiles.append(width, LEVEL_EMPTY_TILE);
+            height++;
+            uniform = false;
+        }
+
+        if (length > width)
+        {
+            //Rare: re-lay the rows read so far at the new width
+            std::string widened;
+            widened.reserve(size_t(length) * (size / (length + 1) + 1));
+            for (int j = 0; j < height; j++)
+            {
+                widened.append(tiles, size_t(j) * width, width);
+                widened.append(length - width, LEVEL_EMPTY_TILE);
+            }
+            tiles.swap(widened);
+            width = length;
+            uniform = false;
+        }
+        else if (length < width)
+        {
+            uniform = false;
+        }
+
+        tiles.append(line, length);
+        tiles.append(width - length, LEVEL_EMPTY_TILE);
+        height++;
+        line = next;
+    }
+    return uniform;
+}
+
+//The rows of one slice of a text map, as found by parseTextLevelParallel
+struct LevelTextSlice
+{
+    std::vector<const char*> lines;
+    std::vector<int> lengths;
+    int lastTileRow;
+    int longest;
+    int shortest;
+    int shortestUpToLastTileRow;
+};
+
+//Calls visit(row, line, length) for every line of the text from begin to end, carriage returns excluded
+template <typename Visit>
+inline void forEachTextLevelRow(const char* begin, const char* end, Visit visit)
+{
+    int row = 0;
+    for (const char* line = begin; line < end; row++)
+    {
+        const char* newline = (const char*)std::memchr(line, '\n', end - line);
+        const char* next = newline != nullptr ? newline + 1 : end;
+        int length = (newline != nullptr ? newline : end) - line;
+        if (length > 0 && line[length - 1] == '\r')
+        {
+            length--;
+        }
+        visit(row, line, length);
+        line = next;
+    }
+}
+
+//Start of slice k of count slices of the text: the first line that starts in or after its equal share, so no row is
+//cut in two. Every slice finds its own start and end this way, slice count ends at the end of the text
+inline const char* textLevelSliceStart(const char* data, size_t size, int k, int count)
+{
+    if (k <= 0)
+    {
+        return data;
+    }
+    if (k >= count)
+    {
+        return data + size;
+    }
+    const char* share = data + size / count * k;
+    const char* newline = (const char*)std::memchr(share - 1, '\n', data + size - (share - 1));
+    return newline != nullptr ? newline + 1 : data + size;
+}
+
+//Same result as parseTextLevel, with the text split into a slice per core. Every slice finds its bounds and the
+//starts and lengths of its rows on its own thread; once the rows before each slice are added up, the slices copy
+//their rows straight from those starts into their place in the grid and pad them, so the grid doesn't depend on the
+//number of threads and the text is scanned only once. Small maps are parsed on the calling thread
+inline bool parseTextLevelParallel(const char* data, size_t size, std::string& tiles, int& width, int& height, int threads = 0)
+{
+    if (threads <= 0)
+    {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    if (threads == 1 || size < LEVEL_PARALLEL_PARSE_MIN_BYTES)
+    {
+        return parseTextLevel(data, size, tiles, width, height);
+    }
+
+    //First pass: the rows of every slice and their lengths
+    std::vector<LevelTextSlice> slices(threads);
+    std::vector<std::thread> workers;
+    for (int k = 0; k < threads; k++)
+    {
+        workers.push_back(std::thread([&slices, data, size, threads, k]()
+        {
+            LevelTextSlice& slice = slices[k];
+            slice.lastTileRow = -1;
+            slice.longest = 0;
+            slice.shortest = INT_MAX;
+            slice.shortestUpToLastTileRow = INT_MAX;
+            const char* begin = textLevelSliceStart(data, size, k, threads);
+            const char* end = textLevelSliceStart(data, size, k + 1, threads);
+            slice.lines.reserve((end - begin) / 64 + 1);
+            slice.lengths.reserve((end - begin) / 64 + 1);
+            forEachTextLevelRow(begin, end, [&slice](int row, const char* line, int length)
+            {
+                slice.lines.push_back(line);
+                slice.lengths.push_back(length);
+                slice.longest = std::max(slice.longest, length);
+                slice.shortest = std::min(slice.shortest, length);
+                if (length > 0)
+                {
+                    slice.lastTileRow = row;
+                    slice.shortestUpToLastTileRow = slice.shortest;
+                }
+            });
+        }));
+    }
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+    workers.clear();
+
+    //Empty rows at the end are dropped, the widest row sets the width and any other length makes the map ragged
+    int last = threads - 1;
+    while (last >= 0 && slices[last].lastTileRow < 0)
+    {
+        last--;
+    }
+    std::vector<int> firstRow(threads, 0);
+    width = 0;
+    height = 0;
+    for (int k = 0; k <= last; k++)
+    {
+        firstRow[k] = height;
+        height += k < last ? (int)slices[k].lines.size() : slices[k].lastTileRow + 1;
+        width = std::max(width, slices[k].longest);
+    }
+    bool uniform = true;
+    for (int k = 0; k <= last; k++)
+    {
+        uniform = uniform && (slices[k].lines.empty() || (k < last ? slices[k].shortest : slices[k].shortestUpToLastTileRow) == width);
+    }
+
+    //Second pass: every slice copies its rows into the grid and fills the rest of short rows with empty tiles,
+    //so every byte of the grid is written by exactly one thread
+    tiles.resize(size_t(width) * height);
+    char* grid = &tiles[0];
+    for (int k = 0; k <= last; k++)
+    {
+        workers.push_back(std::thread([&slices, &firstRow, grid, width, height, k]()
+        {
+            const LevelTextSlice& slice = slices[k];
+            for (size_t r = 0; r < slice.lines.size() && firstRow[k] + r < size_t(height); r++)
+            {
+                char* row = grid + (firstRow[k] + r) * width;
+                std::memcpy(row, slice.lines[r], slice.lengths[r]);
+                std::memset(row + slice.lengths[r], LEVEL_EMPTY_TILE, width - slice.lengths[r]);
+            }
+        }));
+    }
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+    return uniform;
+}
+
+#endif
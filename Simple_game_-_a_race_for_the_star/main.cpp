@@ -5,9 +5,36 @@
 #include <string>
 #include <SDL2/SDL_image.h>
 #include <vector>
+#include <thread>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <atomic>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <memory>
 #include <cmath>
 #include <stdlib.h>
 #include <time.h>
+#include <cstring>
+#include <sys/stat.h>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "baked_texture.h"
+#include "native_format.h"
+#include "async_loader.h"
+#include "file_watcher.h"
+#include "level_format.h"
+#include "mapped_file.h"
 
 enum KEYVARIANTS {
     KEYBOARD,
@@ -19,6 +46,109 @@ enum AVAILABLE_POSITIONS{
     UNAVAILABLE
 };
 
+//Default video memory budget of the texture cache, the first command line argument overrides it in MB
+const Uint64 TEXTURE_BUDGET = 64 * 1024 * 1024;
+
+//A level map read from disk, the tiles live in the parsed text or in the mapping of a compiled level
+struct LevelMap
+{
+    std::string path;
+    std::string text;
+    LMappedFile file;
+    const char* tiles = "";
+    int width = 0;
+    int height = 0;
+};
+
+class LTextureCache
+{
+public:
+    //A decoded image shared by every LTexture loaded from the same path
+    struct Entry
+    {
+        std::string path;
+        std::string key;
+        SDL_Texture* texture = nullptr;
+        int width = 0;
+        int height = 0;
+        int refCount = 0;
+
+        //Estimated video memory of the texture and the frame it was last drawn in
+        Uint64 bytes = 0;
+        Uint64 lastDrawn = 0;
+
+        //The last reference was dropped, endFrame destroys the texture unless it is acquired again first
+        bool released = false;
+    };
+
+    //Returns the entry for path, decoding the image only on the first request
+    Entry* acquire(std::string path);
+
+    //Returns the entry for path resampled to width x height, drawing it at that size is a 1:1 copy
+    Entry* acquireScaled(std::string path, int width, int height);
+
+    //Decodes the images in parallel and keeps them until they are acquired, resampled when a size is given
+    void prefetch(std::vector<std::string> paths, int width = 0, int height = 0);
+
+    //Drops one reference, the last one leaves the texture cached until the end of the frame
+    void release(Entry* entry);
+
+    //Returns the texture of entry for drawing this frame, decoding it again if it was evicted
+    SDL_Texture* use(Entry* entry);
+
+    //Limits the memory of resident textures, least recently drawn ones are evicted past it
+    void setBudget(Uint64 bytes) {budget = bytes;}
+
+    //Ends a frame, destroying released textures and evicting others until the resident ones fit the budget
+    void endFrame();
+
+    //Decodes the image at path again and updates every cached size of it in place, returns false when it is not cached
+    bool reload(std::string path);
+
+    //Destroys every cached texture
+    void clear();
+
+    //Cache statistics
+    int getHits() const {return hits;}
+    int getMisses() const {return misses;}
+    int getSize() const {return entries.size();}
+    double getLoadMilliseconds() const {return loadMilliseconds;}
+    Uint64 getResidentBytes() const {return residentBytes;}
+    Uint64 getPeakBytes() const {return peakBytes;}
+    int getEvictions() const {return evictions;}
+    int getReloads() const {return reloads;}
+
+private:
+    //Entries of resampled images are stored under the path with the size appended
+    static std::string keyOf(std::string path, int width, int height);
+
+    //Decodes the image of entry again at the size it is cached at
+    static SDL_Surface* decodeEntry(const Entry& entry, bool preferBaked);
+
+    //Images edited while the game runs are decoded from the file from then on, their baked data is stale
+    bool preferBaked(const std::string& path) const {return editedPaths.count(path) == 0;}
+
+    //Takes over texture as the texture of entry and accounts for its memory
+    void setTexture(Entry& entry, SDL_Texture* texture);
+
+    //Creates the texture of a decoded surface and stores it under key, the surface is freed
+    Entry* insert(std::string key, std::string path, SDL_Surface* surface);
+
+    std::map<std::string, Entry> entries;
+    std::set<std::string> editedPaths;
+    int hits = 0;
+    int misses = 0;
+    double loadMilliseconds = 0.0;
+
+    //Residency
+    Uint64 budget = TEXTURE_BUDGET;
+    Uint64 residentBytes = 0;
+    Uint64 peakBytes = 0;
+    Uint64 frame = 0;
+    int evictions = 0;
+    int reloads = 0;
+};
+
 class LTexture
 {
 public:
@@ -31,6 +161,12 @@ public:
     //Loads image at specified path
     bool loadFromFile(std::string path);
 
+    //Loads image at specified path resampled to the size it is drawn at
+    bool loadFromFile(std::string path, int width, int height);
+
+    //Creates texture from a decoded surface, the surface is freed
+    bool loadFromSurface(SDL_Surface* surface);
+
     //Deallocate texture
     void free();
 
@@ -41,7 +177,7 @@ public:
     //Gets image dimensions
     int getWidth() const;
     int getHeight() const;
-    SDL_Texture* getTexture() {return mTexture;}
+    SDL_Texture* getTexture();
 
 private:
     //The actual hardware texture
@@ -50,11 +186,14 @@ private:
     //Image dimensions
     int mWidth;
     int mHeight;
+
+    //Shared cache slot, set when the texture was loaded from a file
+    LTextureCache::Entry* mCacheEntry;
 };
 
 struct Wall{
     Wall(float xp, float yp, float w, float h) : xp(xp), yp(yp), w(w), h(h) {
-        this->texture.loadFromFile("../level/wall_fill.png");
+        this->texture.loadFromFile("../level/wall_fill.png", w, h);
     }
     float xp, yp;
     float w, h;
@@ -114,29 +253,68 @@ private:
 
 class Level{
 public:
-    Level(std::string map);
+    Level(const char* tiles);
     ~Level();
 
-    void loadNewMap(std::string map);
+    //Starts over on a levelMapWidth x levelMapHeight map, chunks are built again around the camera
+    void loadNewMap(const char* tiles);
+
+    //Builds the chunks around the camera and drops the ones that left its neighbourhood
+    void update(float init_x, float init_y);
+
     void render(float init_x, float init_y);
-    std::vector<std::vector<int>> getAvailablePositions();
-    std::vector<Wall*> getlevelWalls() { return levelWalls; }
+
+    //Whether a player can be placed on the tile at column, row
+    bool isAvailable(int column, int row) const;
+    void takePosition(int column, int row);
+
+    //Replaces walls with the walls of the loaded chunks and the target overlapping the rectangle at x, y
+    //of size w x h, in map order
+    void queryWalls(float x, float y, float w, float h, std::vector<Wall*>& walls);
+    int getLoadedChunks() const { return chunks.size(); }
 
 private:
-    std::vector<Wall*> levelWalls;
-    std::vector<std::vector<int>> availablePositions;
+    //CHUNK_SIZE x CHUNK_SIZE tiles of the map, its walls are the colliders and the draw list of that area.
+    //The grid is a uniform grid over the chunk, one cell per tile holding its wall or nullptr
+    struct Chunk
+    {
+        std::vector<Wall*> walls;
+        std::vector<Wall*> grid;
+    };
+
+    //Creates the walls of the chunk at column, row of the chunk grid
+    void loadChunk(int column, int row, Chunk& chunk);
+    void unloadChunk(Chunk& chunk);
+
+    //The map, owned by the active LevelMap
+    const char* tiles;
+    int chunkColumns;
+    int chunkRows;
+
+    //Loaded chunks by row * chunkColumns + column
+    std::map<int, Chunk> chunks;
+
+    //The target lives outside the chunks, the arrow points at it from anywhere in the level
+    Wall* target;
+    std::vector<size_t> takenPositions;
+
+    //Reused every frame for the walls on screen
+    std::vector<Wall*> visibleWalls;
 };
 
 const int SCREEN_WIDTH = 1280;
 const int SCREEN_HEIGHT = 720;
+const int IDLE_POLL_MS = 100; // longest an unchanged frame sleeps before the watched files are checked again
 const int JOYSTICK_DEAD_ZONE = 10000;
 const float PLAYER_WIDTH = 0.5; // * map_tile_size
+const int CHUNK_SIZE = 32; // tiles per chunk side
+const int CHUNK_MARGIN = 1; // chunks kept loaded past the screen edges
 
 SDL_Window* gWindow = nullptr;
 LTexture player1won;
 LTexture player2won;
 LTexture pointingArrow;
-Wall* star;
+Wall* star = nullptr;
 LTexture points[5];
 
 std::string levelMaps[3] = {
@@ -145,9 +323,13 @@ std::string levelMaps[3] = {
         "../level_map_3.txt"
 };
 std::string* activeLevelMap = &levelMaps[0];
+std::string loadedLevelMap = "";
 bool levelHasJustBeenChanged = false;
 
-std::string levelMapString = "";
+std::unique_ptr<LevelMap> levelMap;
+const char* levelMapTiles = "";
+std::future<std::unique_ptr<LevelMap>> nextLevelMap;
+std::string nextLevelMapPath = "";
 int levelMapWidth = 0;
 int levelMapHeight = 0;
 int map_tile_size = 40;
@@ -156,17 +338,28 @@ float camera_x = 0.0f;
 float camera_y = 0.0f;
 
 SDL_Renderer* gRenderer = nullptr;
+SDL_RendererInfo gRendererInfo;
+SDL_Surface* decodeSurface(std::string path, bool preferBaked = true);
+LAsyncLoader gLoader([](std::string path) { return decodeSurface(path); });
+std::atomic<int> gBakedLoads(0);
+std::atomic<int> gDecodedLoads(0);
+LTextureCache gTextureCache;
 SDL_Joystick* gGameController = NULL;
 
 bool init();
 bool readLevelMap(std::string filename);
-void checkCircularCollision(Player &circlePlayer, Wall* wall, Level &level, Player &player1);
-void checkRectangularCollision(Player &player1, Wall* w, Level &level, Player &player2);
+bool readLevelMap(std::string filename, LevelMap& map);
+bool readCompiledLevelMap(std::string path, std::string textPath, LevelMap& map);
+void useLevelMap(std::unique_ptr<LevelMap> map);
+void prefetchLevelMap(std::string filename);
+bool checkCircularCollision(Player &circlePlayer, Wall* wall);
+bool checkRectangularCollision(Player &player1, Wall* w);
 void switchLevel(Level &level, std::string* &newMap, Player &player1, Player &player2);
 void generateRandomPositions(float &x, float &y, Level &level);
 void renderActiveScore(Player &player1, Player &player2);
 void renderOldScore(Player &player1, Player &player2);
 void renderStar(Player &player1, Player &player2);
+SDL_Surface* loadBakedSurface(std::string path);
 bool loadMedia();
 void close();
 
@@ -180,6 +373,7 @@ int main(int argc, char* args[])
     else
     {
 
+        Uint64 startupBegin = SDL_GetPerformanceCounter();
         if (!loadMedia())
         {
             printf("\nCould not load media\n");
@@ -193,10 +387,19 @@ int main(int argc, char* args[])
             SDL_Event e;
             srand(time(NULL));
 
+            if (argc > 1 && atoi(args[1]) > 0)
+            {
+                gTextureCache.setBudget(Uint64(atoi(args[1])) * 1024 * 1024);
+            }
+
             readLevelMap(*activeLevelMap);
             activeLevelMap++;
+            prefetchLevelMap(*activeLevelMap);
             map_tile_size = SCREEN_WIDTH / 10;
-            Level level(levelMapString);
+
+            //Tiles are resampled to the tile size once instead of being scaled on every draw
+            gTextureCache.prefetch({"../level/wall_fill.png", "../level/target.png"}, map_tile_size, map_tile_size);
+            Level level(levelMapTiles);
 
             float p1pos_x = 0;
             float p1pos_y = 0;
@@ -206,14 +409,65 @@ int main(int argc, char* args[])
             generateRandomPositions(p2pos_x, p2pos_y, level);
             Player player1(p1pos_x, p1pos_y, "../square_player.png", KEYBOARD);
             Player player2(p2pos_x, p2pos_y, "../circle.png", GAMEPAD);
+
+            //Startup report, run the bake_assets target to skip PNG decoding
+            printf("Startup: %.2f ms, texture I/O %.2f ms (%d baked, %d decoded)\n",
+                   (SDL_GetPerformanceCounter() - startupBegin) * 1000.0 / SDL_GetPerformanceFrequency(),
+                   gTextureCache.getLoadMilliseconds(), gBakedLoads.load(), gDecodedLoads.load());
             int shared_camera_x = 0;
             int shared_camera_y = 0;
+            std::vector<Wall*> nearbyWalls;
+
+            //Edited maps and tiles are picked up while the game runs
+            LFileWatcher watcher;
+            for (const std::string& map : levelMaps)
+            {
+                watcher.watch(map);
+            }
+            watcher.watch("../level/wall_fill.png");
+            watcher.watch("../level/target.png");
+            std::vector<std::string> changedFiles;
+
+            //What the frame on screen shows: the camera, both players, the score and whether player 2 is in.
+            //While none of it changes and nothing is reloaded the frame is neither drawn nor presented again
+            float drawnState[8] = {};
+            bool redraw = true;
 
             //While application is running
             while (!quit)
             {
-                //Clear screen
-                SDL_RenderClear(gRenderer);
+                //Rebuild only what changed on disk, other maps are read when the level switches to them
+                if (watcher.poll(changedFiles))
+                {
+                    for (const std::string& path : changedFiles)
+                    {
+                        if (path == loadedLevelMap)
+                        {
+                            //Read aside and swapped in only when it worked, a map still being saved keeps the running level
+                            std::unique_ptr<LevelMap> reloaded(new LevelMap());
+                            if (readLevelMap(path, *reloaded))
+                            {
+                                useLevelMap(std::move(reloaded));
+                                level.loadNewMap(levelMapTiles);
+                                redraw = true;
+                                printf("Reloaded %s\n", path.c_str());
+                            }
+                            else
+                            {
+                                printf("Keeping the running level, %s could not be read\n", path.c_str());
+                            }
+                        }
+                        else if (path == nextLevelMapPath)
+                        {
+                            prefetchLevelMap(path);
+                        }
+                        else if (gTextureCache.reload(path))
+                        {
+                            printf("Reloaded %s\n", path.c_str());
+                            redraw = true;
+                        }
+                    }
+                }
 
                 //Handle events on queue
                 while (SDL_PollEvent(&e) != 0)
@@ -224,6 +478,12 @@ int main(int argc, char* args[])
                         quit = true;
                     }
 
+                    //The window was uncovered or resized
+                    if (e.type == SDL_WINDOWEVENT)
+                    {
+                        redraw = true;
+                    }
+
                     player1.handleEvent(e);
                     if (gGameController != NULL) { player2.handleEvent(e); }
                 }
@@ -260,17 +520,57 @@ int main(int argc, char* args[])
                 if( camera_x > levelMapWidth  * map_tile_size - SCREEN_WIDTH  ) { camera_x = levelMapWidth  * map_tile_size - SCREEN_WIDTH ; }
                 if( camera_y > levelMapHeight * map_tile_size - SCREEN_HEIGHT ) { camera_y = levelMapHeight * map_tile_size - SCREEN_HEIGHT; }
 
-                //checking if the players aren't colliding with the map
-                for (Wall* w : level.getlevelWalls()){
-                    //player 1 (square)
-                    checkRectangularCollision(player1, w, level, player2);
+                //Only the chunks around the camera exist, whatever the size of the map
+                level.update(camera_x, camera_y);
+
+                //checking if the players aren't colliding with the map, only the walls within a tile of a player can touch it
+                //player 1 (square)
+                bool player1ReachedTarget = false;
+                bool player2ReachedTarget = false;
+                level.queryWalls(player1.getPosX() - map_tile_size, player1.getPosY() - map_tile_size,
+                                 player1.getPWidth() + 2 * map_tile_size, player1.getPHeight() + 2 * map_tile_size, nearbyWalls);
+                for (Wall* w : nearbyWalls){
+                    if (checkRectangularCollision(player1, w)) {
+                        player1ReachedTarget = true;
+                        break;
+                    }
+                }
 
-                    //player 2 (circle)
-                    if (SDL_NumJoysticks() > 0 && gGameController != nullptr) {
-                        checkCircularCollision(player2, w, level, player1);
+                //player 2 (circle)
+                if (!player1ReachedTarget && SDL_NumJoysticks() > 0 && gGameController != nullptr) {
+                    level.queryWalls(player2.getPosX() - map_tile_size, player2.getPosY() - map_tile_size,
+                                     player2.getPWidth() + 2 * map_tile_size, player2.getPHeight() + 2 * map_tile_size, nearbyWalls);
+                    for (Wall* w : nearbyWalls){
+                        if (checkCircularCollision(player2, w)) {
+                            player2ReachedTarget = true;
+                            break;
+                        }
                     }
                 }
 
+                //The level is switched once the walls are no longer in use, switchLevel frees them
+                if (player1ReachedTarget) {
+                    player2.updateOldPoints();
+                    player1.addPoint();
+                    switchLevel(level, activeLevelMap, player1, player2);
+                } else if (player2ReachedTarget) {
+                    player1.updateOldPoints();
+                    player2.addPoint();
+                    switchLevel(level, activeLevelMap, player1, player2);
+                }
+
+                float frameState[8] = { camera_x, camera_y, player1.getPosX(), player1.getPosY(), player2.getPosX(), player2.getPosY(),
+                                        float(player1.getActivePoints() * 4 + player2.getActivePoints()), gGameController != NULL ? 1.0f : 0.0f };
+                if (!redraw && !levelHasJustBeenChanged && std::equal(frameState, frameState + 8, drawnState)) {
+                    SDL_WaitEventTimeout(NULL, IDLE_POLL_MS);
+                    continue;
+                }
+                std::copy(frameState, frameState + 8, drawnState);
+                redraw = false;
+
+                //Clear screen
+                SDL_RenderClear(gRenderer);
+
                 //rendering players
                 player1.render(camera_x, camera_y);
                 if (gGameController != nullptr) {
@@ -296,6 +596,9 @@ int main(int argc, char* args[])
 
                 //Update screen
                 SDL_RenderPresent(gRenderer);
+
+                //Textures that were not drawn lately give their memory back
+                gTextureCache.endFrame();
             }
         }
     }
@@ -341,6 +644,9 @@ bool init()
                 //Initialize renderer color #b53921
                 SDL_SetRenderDrawColor(gRenderer, 0xb5, 0x39, 0x21, 0xFF);
 
+                //Surfaces are converted to the texture formats this renderer prefers
+                SDL_GetRendererInfo(gRenderer, &gRendererInfo);
+
                 //Initialize PNG loading
                 int imgFlags = IMG_INIT_PNG;
                 if (!(IMG_Init(imgFlags) & imgFlags))
@@ -356,35 +662,107 @@ bool init()
 }
 
 bool readLevelMap(std::string filename) {
-    bool success = true;
-    std::ifstream file;
-    std::string line;
-    file.open(filename);
-    levelMapString = "";
-    levelMapHeight = 0;
-    levelMapWidth = 0;
-    if (!file.good()) {
+    std::unique_ptr<LevelMap> map(new LevelMap());
+    bool success = readLevelMap(filename, *map);
+    useLevelMap(std::move(map));
+    return success;
+}
+
+bool readLevelMap(std::string filename, LevelMap& map) {
+    //Touches no globals, the next level is read on a worker thread
+    map.path = filename;
+
+    //Prefer the map compiled by the compile_levels target, its tiles are used in place
+    if (readCompiledLevelMap(compiledLevelPath(filename), filename, map)) {
+        return true;
+    }
+
+    //One bulk read, the parser writes the rows straight into the tile grid, a slice of rows per core on big maps
+    FILE* file = fopen(filename.c_str(), "rb");
+    if (file == nullptr) {
         std::cout << "Wrong file " << filename << std::endl;
-        return !success;
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    std::string text(std::max(size, 0L), '\0');
+    bool read = text.empty() || fread(&text[0], text.size(), 1, file) == 1;
+    fclose(file);
+    if (!read) {
+        std::cout << "Wrong file " << filename << std::endl;
+        return false;
+    }
+
+    if (!parseTextLevelParallel(text.data(), text.size(), map.text, map.width, map.height)) {
+        printf("Warning: rows of %s differ in length, short rows are padded with empty tiles\n", filename.c_str());
+    }
+    if (map.width <= 0 || map.height <= 0) {
+        std::cout << "Empty map " << filename << std::endl;
+        return false;
+    }
+    map.tiles = map.text.c_str();
+    return true;
+}
+
+bool readCompiledLevelMap(std::string path, std::string textPath, LevelMap& map) {
+    //A text map edited after compiling wins over the stale compiled one
+    struct stat compiledStatus, textStatus;
+    if (stat(path.c_str(), &compiledStatus) != 0 ||
+        (stat(textPath.c_str(), &textStatus) == 0 && textStatus.st_mtime > compiledStatus.st_mtime)) {
+        return false;
+    }
+
+    //Only the pages of the chunks around the camera are read from disk
+    LMappedFile& file = map.file;
+    if (!file.open(path)) {
+        return false;
     }
-    else {
-        levelMapString.clear();
-        while (!file.eof()) {
-            levelMapHeight++;
-            std::getline(file, line);
-            levelMapString += line;
-        }
-        levelMapWidth = line.size();
 
+    //Check the header before trusting the sizes in it, the game draws the first layer
+    map.tiles = compiledLevelTiles(file.getData(), file.getSize(), map.width, map.height);
+    if (map.tiles == nullptr) {
+        printf("Compiled level %s is corrupt!\n", path.c_str());
+        map.tiles = "";
         file.close();
-        return success;
+        return false;
     }
+    return true;
+}
+
+void useLevelMap(std::unique_ptr<LevelMap> map) {
+    //The previous map is freed here, the Level must be given the new tiles right after
+    levelMap = std::move(map);
+    levelMapTiles = levelMap->tiles;
+    levelMapWidth = levelMap->width;
+    levelMapHeight = levelMap->height;
+    loadedLevelMap = levelMap->path;
+}
+
+void prefetchLevelMap(std::string filename) {
+    //Read on its own thread while the round is played, switchLevel picks it up.
+    //Replacing a pending read waits for it first
+    nextLevelMapPath = filename;
+    nextLevelMap = std::async(std::launch::async, [filename]() {
+        std::unique_ptr<LevelMap> map(new LevelMap());
+        if (!readLevelMap(filename, *map)) {
+            map.reset();
+        }
+        return map;
+    });
 }
 
 bool loadMedia()
 {
     //Loading success flag
     bool success = true;
+
+    //Decode every image on the worker pool up front, the loads below find them in the cache
+    gTextureCache.prefetch({
+        "../0.png", "../1.png", "../2.png", "../3.png", "../colon.png",
+        "../player1won.png", "../player2won.png", "../pointingArrow.png",
+        "../square_player.png", "../circle.png"
+    });
     if(!points[0].loadFromFile( "../0.png")){
         printf("Failed to load 0.png texture image!\n");
         success = false;
@@ -430,8 +808,11 @@ bool loadMedia()
 
 void close()
 {
+    //Join the loader workers
+    gLoader.stop();
+
     //Free loaded images
-    for (LTexture t : points){
+    for (LTexture& t : points){
         t.free();
     }
     player1won.free();
@@ -442,6 +823,11 @@ void close()
     SDL_JoystickClose( gGameController );
     gGameController = NULL;
 
+    //Destroy whatever is still cached
+    printf("Texture cache: %d hits, %d misses, %d evictions, %d reloads, peak %.1f MB\n", gTextureCache.getHits(), gTextureCache.getMisses(),
+           gTextureCache.getEvictions(), gTextureCache.getReloads(), gTextureCache.getPeakBytes() / (1024.0 * 1024.0));
+    gTextureCache.clear();
+
     //Destroy window
     SDL_DestroyRenderer(gRenderer);
     SDL_DestroyWindow(gWindow);
@@ -453,12 +839,372 @@ void close()
     SDL_Quit();
 }
 
+SDL_Surface* loadBakedSurface(std::string path)
+{
+    //"../level/wall_fill.png" is baked to "../baked/level/wall_fill.tex"
+    if (path.compare(0, 3, "../") != 0 || path.rfind('.') == std::string::npos)
+    {
+        return nullptr;
+    }
+    std::string bakedPath = "../baked/" + path.substr(3, path.rfind('.') - 3) + ".tex";
+
+    SDL_RWops* file = SDL_RWFromFile(bakedPath.c_str(), "rb");
+    if (file == nullptr)
+    {
+        return nullptr;
+    }
+
+    BakedTextureHeader header;
+    std::vector<Uint32> data;
+    bool valid = SDL_RWread(file, &header, sizeof(header), 1) == 1 &&
+                 std::memcmp(header.magic, BAKED_TEXTURE_MAGIC, sizeof(header.magic)) == 0 &&
+                 header.version == BAKED_TEXTURE_VERSION &&
+                 header.dataSize % sizeof(Uint32) == 0;
+    if (valid)
+    {
+        data.resize(header.dataSize / sizeof(Uint32));
+        valid = data.empty() || SDL_RWread(file, data.data(), header.dataSize, 1) == 1;
+    }
+    SDL_RWclose(file);
+
+    if (valid && (header.flags & BAKED_TEXTURE_RLE))
+    {
+        std::vector<Uint32> pixels;
+        valid = bakedDecodeRLE(data, size_t(header.width) * header.height, pixels);
+        data.swap(pixels);
+    }
+    if (!valid || data.size() != size_t(header.width) * header.height)
+    {
+        printf("Baked texture %s is corrupt, decoding %s instead\n", bakedPath.c_str(), path.c_str());
+        return nullptr;
+    }
+
+    //The color key is already baked into the alpha channel, the pixels only need copying
+    SDL_Surface* bakedSurface = SDL_CreateRGBSurfaceWithFormat(0, header.width, header.height, 32, header.format);
+    if (bakedSurface == nullptr)
+    {
+        printf("Unable to create surface for %s! SDL Error: %s\n", bakedPath.c_str(), SDL_GetError());
+        return nullptr;
+    }
+    for (int y = 0; y < bakedSurface->h; y++)
+    {
+        std::memcpy((Uint8*)bakedSurface->pixels + y * bakedSurface->pitch, &data[y * header.width], header.width * sizeof(Uint32));
+    }
+
+    return bakedSurface;
+}
+
+SDL_Surface* decodeSurface(std::string path, bool preferBaked)
+{
+    //Prefer the pixels written by asset_baker, unless the image was just edited
+    SDL_Surface* bakedSurface = preferBaked ? loadBakedSurface(path) : nullptr;
+    if (bakedSurface != nullptr)
+    {
+        gBakedLoads++;
+        return convertToNativeFormat(bakedSurface, gRendererInfo);
+    }
+
+    //Load image at specified path
+    SDL_Surface* loadedSurface = loadKeyedSurface(SDL_RWFromFile(path.c_str(), "rb"), path);
+    if (loadedSurface != nullptr)
+    {
+        gDecodedLoads++;
+    }
+
+    return convertToNativeFormat(loadedSurface, gRendererInfo);
+}
+
+LTextureCache::Entry* LTextureCache::acquire(std::string path)
+{
+    return acquireScaled(path, 0, 0);
+}
+
+LTextureCache::Entry* LTextureCache::acquireScaled(std::string path, int width, int height)
+{
+    //Reuse the texture if this image has already been decoded at this size
+    std::string key = keyOf(path, width, height);
+    std::map<std::string, Entry>::iterator found = entries.find(key);
+    if (found != entries.end())
+    {
+        hits++;
+        found->second.refCount++;
+        found->second.released = false;
+        return &found->second;
+    }
+    misses++;
+
+    Uint64 loadStart = SDL_GetPerformanceCounter();
+    Entry* entry = insert(key, path, scaleSurface(decodeSurface(path, preferBaked(path)), width, height));
+    if (entry != nullptr)
+    {
+        entry->refCount++;
+    }
+    loadMilliseconds += (SDL_GetPerformanceCounter() - loadStart) * 1000.0 / SDL_GetPerformanceFrequency();
+    return entry;
+}
+
+void LTextureCache::prefetch(std::vector<std::string> paths, int width, int height)
+{
+    //Decode every missing image on the worker pool, only the uploads run on this thread
+    Uint64 loadStart = SDL_GetPerformanceCounter();
+    std::vector<std::future<SDL_Surface*>> surfaces(paths.size());
+    for (int i = 0; i < paths.size(); i++)
+    {
+        if (entries.find(keyOf(paths[i], width, height)) == entries.end())
+        {
+            //An edited image is decoded from its PNG, the loader's decode would prefer the stale baked copy
+            std::string path = paths[i];
+            bool baked = preferBaked(path);
+            surfaces[i] = gLoader.submit([path, width, height, baked]() { return scaleSurface(decodeSurface(path, baked), width, height); });
+        }
+    }
+
+    for (int i = 0; i < paths.size(); i++)
+    {
+        if (!surfaces[i].valid())
+        {
+            continue;
+        }
+        SDL_Surface* surface = surfaces[i].get();
+        std::string key = keyOf(paths[i], width, height);
+        if (entries.find(key) != entries.end())
+        {
+            //Listed twice
+            SDL_FreeSurface(surface);
+            continue;
+        }
+        misses++;
+        insert(key, paths[i], surface);
+    }
+    loadMilliseconds += (SDL_GetPerformanceCounter() - loadStart) * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+std::string LTextureCache::keyOf(std::string path, int width, int height)
+{
+    if (width <= 0 || height <= 0)
+    {
+        return path;
+    }
+    return path + "@" + std::to_string(width) + "x" + std::to_string(height);
+}
+
+LTextureCache::Entry* LTextureCache::insert(std::string key, std::string path, SDL_Surface* surface)
+{
+    if (surface == nullptr)
+    {
+        return nullptr;
+    }
+
+    //Create texture from surface pixels
+    SDL_Texture* newTexture = SDL_CreateTextureFromSurface(gRenderer, surface);
+    if (newTexture == NULL)
+    {
+        printf("Unable to create texture from %s! SDL Error: %s\n", path.c_str(), SDL_GetError());
+        SDL_FreeSurface(surface);
+        return nullptr;
+    }
+
+    Entry& entry = entries[key];
+    entry.path = path;
+    entry.key = key;
+    setTexture(entry, newTexture);
+    entry.width = surface->w;
+    entry.height = surface->h;
+    entry.refCount = 0;
+    entry.lastDrawn = frame;
+    entry.released = false;
+
+    //Get rid of old loaded surface
+    SDL_FreeSurface(surface);
+    return &entry;
+}
+
+void LTextureCache::release(Entry* entry)
+{
+    //Destroyed by endFrame, a level switch acquiring the same image in this frame still finds it resident
+    entry->refCount--;
+    entry->released = entry->refCount <= 0;
+}
+
+SDL_Texture* LTextureCache::use(Entry* entry)
+{
+    entry->lastDrawn = frame;
+    if (entry->texture != NULL)
+    {
+        return entry->texture;
+    }
+
+    //Evicted earlier, decode it again from the baked data, or from the image when it was edited since
+    Uint64 loadStart = SDL_GetPerformanceCounter();
+    SDL_Surface* surface = decodeEntry(*entry, preferBaked(entry->path));
+    if (surface != nullptr)
+    {
+        SDL_Texture* newTexture = SDL_CreateTextureFromSurface(gRenderer, surface);
+        if (newTexture == NULL)
+        {
+            printf("Unable to create texture from %s! SDL Error: %s\n", entry->path.c_str(), SDL_GetError());
+        }
+        setTexture(*entry, newTexture);
+        SDL_FreeSurface(surface);
+        reloads++;
+    }
+    loadMilliseconds += (SDL_GetPerformanceCounter() - loadStart) * 1000.0 / SDL_GetPerformanceFrequency();
+    return entry->texture;
+}
+
+void LTextureCache::endFrame()
+{
+    //Nothing holds released textures anymore
+    for (std::map<std::string, Entry>::iterator it = entries.begin(); it != entries.end();)
+    {
+        if (it->second.released && it->second.refCount <= 0)
+        {
+            setTexture(it->second, NULL);
+            it = entries.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    //Evict the least recently drawn texture until the rest fit, never one drawn this frame.
+    //Unreferenced entries go first and are forgotten, referenced ones keep their slot for use() to fill again
+    while (residentBytes > budget)
+    {
+        std::map<std::string, Entry>::iterator victim = entries.end();
+        for (std::map<std::string, Entry>::iterator it = entries.begin(); it != entries.end(); ++it)
+        {
+            const Entry& entry = it->second;
+            if (entry.texture == NULL || entry.lastDrawn >= frame)
+            {
+                continue;
+            }
+            if (victim == entries.end() || (entry.refCount <= 0) > (victim->second.refCount <= 0) ||
+                ((entry.refCount <= 0) == (victim->second.refCount <= 0) && entry.lastDrawn < victim->second.lastDrawn))
+            {
+                victim = it;
+            }
+        }
+        if (victim == entries.end())
+        {
+            break;
+        }
+
+        setTexture(victim->second, NULL);
+        evictions++;
+        if (victim->second.refCount <= 0)
+        {
+            entries.erase(victim);
+        }
+    }
+    frame++;
+}
+
+SDL_Surface* LTextureCache::decodeEntry(const Entry& entry, bool preferBaked)
+{
+    //Resampled entries keep the size they are drawn at, the others take the size of the image
+    SDL_Surface* surface = decodeSurface(entry.path, preferBaked);
+    if (entry.key != entry.path)
+    {
+        surface = scaleSurface(surface, entry.width, entry.height);
+    }
+    return surface;
+}
+
+void LTextureCache::setTexture(Entry& entry, SDL_Texture* texture)
+{
+    if (entry.texture != NULL)
+    {
+        SDL_DestroyTexture(entry.texture);
+        residentBytes -= entry.bytes;
+    }
+    entry.texture = texture;
+    entry.bytes = 0;
+
+    //Estimated from the size and format, drivers may pad or keep a shadow copy
+    if (texture != NULL)
+    {
+        Uint32 format;
+        int width, height;
+        SDL_QueryTexture(texture, &format, NULL, &width, &height);
+        entry.bytes = Uint64(width) * height * SDL_BYTESPERPIXEL(format);
+        residentBytes += entry.bytes;
+        peakBytes = std::max(peakBytes, residentBytes);
+    }
+}
+
+bool LTextureCache::reload(std::string path)
+{
+    //Acquired or decoded again later, the image comes from the edited file as well
+    editedPaths.insert(path);
+    bool cached = false;
+    for (std::map<std::string, Entry>::iterator it = entries.begin(); it != entries.end(); ++it)
+    {
+        Entry& entry = it->second;
+        if (entry.path != path)
+        {
+            continue;
+        }
+        cached = true;
+
+        //Evicted textures are decoded from the edited file once they are drawn again
+        if (entry.texture == NULL)
+        {
+            continue;
+        }
+
+        SDL_Surface* surface = decodeEntry(entry, false);
+        if (surface == nullptr)
+        {
+            continue;
+        }
+
+        //Overwrite the pixels of the existing texture when it still fits, every LTexture using it sees the change.
+        //A color key that was not turned into alpha needs SDL_CreateTextureFromSurface
+        Uint32 format, key;
+        int width, height;
+        SDL_QueryTexture(entry.texture, &format, NULL, &width, &height);
+        SDL_LockSurface(surface);
+        bool updated = width == surface->w && height == surface->h && format == surface->format->format &&
+                       SDL_GetColorKey(surface, &key) != 0 && SDL_UpdateTexture(entry.texture, NULL, surface->pixels, surface->pitch) == 0;
+        SDL_UnlockSurface(surface);
+        if (!updated)
+        {
+            SDL_Texture* newTexture = SDL_CreateTextureFromSurface(gRenderer, surface);
+            if (newTexture == NULL)
+            {
+                printf("Unable to create texture from %s! SDL Error: %s\n", path.c_str(), SDL_GetError());
+            }
+            else
+            {
+                setTexture(entry, newTexture);
+                entry.width = surface->w;
+                entry.height = surface->h;
+            }
+        }
+        SDL_FreeSurface(surface);
+    }
+    return cached;
+}
+
+void LTextureCache::clear()
+{
+    for (std::map<std::string, Entry>::iterator it = entries.begin(); it != entries.end(); ++it)
+    {
+        SDL_DestroyTexture(it->second.texture);
+    }
+    entries.clear();
+    residentBytes = 0;
+}
+
 LTexture::LTexture()
 {
     //Initialize
     mTexture = NULL;
     mWidth = 0;
     mHeight = 0;
+    mCacheEntry = nullptr;
 }
 
 LTexture::~LTexture()
@@ -468,48 +1214,67 @@ LTexture::~LTexture()
 }
 
 bool LTexture::loadFromFile(std::string path)
+{
+    return loadFromFile(path, 0, 0);
+}
+
+bool LTexture::loadFromFile(std::string path, int width, int height)
 {
     //Get rid of preexisting texture
     free();
 
-    //The final texture
-    SDL_Texture* newTexture = nullptr;
+    //Share the texture with every other LTexture loaded from this path at this size
+    mCacheEntry = gTextureCache.acquireScaled(path, width, height);
+    if (mCacheEntry == nullptr)
+    {
+        return false;
+    }
 
-    //Load image at specified path
-    SDL_Surface* loadedSurface = IMG_Load(path.c_str());
-    if (loadedSurface == nullptr)
+    mWidth = mCacheEntry->width;
+    mHeight = mCacheEntry->height;
+    return true;
+}
+
+bool LTexture::loadFromSurface(SDL_Surface* surface)
+{
+    //Get rid of preexisting texture
+    free();
+
+    if (surface == nullptr)
     {
-        printf("Unable to load image %s! SDL_image Error: %s\n", path.c_str(), IMG_GetError());
+        return false;
+    }
+
+    //Create texture from surface pixels
+    mTexture = SDL_CreateTextureFromSurface(gRenderer, surface);
+    if (mTexture == NULL)
+    {
+        printf("Unable to create texture from surface! SDL Error: %s\n", SDL_GetError());
     }
     else
     {
-        //Color key image
-        SDL_SetColorKey(loadedSurface, SDL_TRUE, SDL_MapRGB(loadedSurface->format, 0xFF, 0x11, 0x17));
-
-        //Create texture from surface pixels
-        newTexture = SDL_CreateTextureFromSurface(gRenderer, loadedSurface);
-        if (newTexture == NULL)
-        {
-            printf("Unable to create texture from %s! SDL Error: %s\n", path.c_str(), SDL_GetError());
-        }
-        else
-        {
-            //Get image dimensions
-            mWidth = loadedSurface->w;
-            mHeight = loadedSurface->h;
-        }
-
-        //Get rid of old loaded surface
-        SDL_FreeSurface(loadedSurface);
+        //Get image dimensions
+        mWidth = surface->w;
+        mHeight = surface->h;
     }
 
-    //Return success
-    mTexture = newTexture;
+    //Get rid of the decoded surface
+    SDL_FreeSurface(surface);
     return mTexture != NULL;
 }
 
 void LTexture::free()
 {
+    //Give a shared texture back to the cache instead of destroying it
+    if (mCacheEntry != nullptr)
+    {
+        gTextureCache.release(mCacheEntry);
+        mCacheEntry = nullptr;
+        mTexture = NULL;
+        mWidth = 0;
+        mHeight = 0;
+    }
+
     //Free texture if it exists
     if (mTexture != NULL)
     {
@@ -522,24 +1287,35 @@ void LTexture::free()
 
 void LTexture::render1(int x, int y)
 {
-    //Set rendering space and render1 to screen
-    SDL_Rect renderQuad = { x, y, mWidth, mHeight };
-    SDL_RenderCopy(gRenderer, mTexture, NULL, &renderQuad);
+    render2(x, y, getWidth(), getHeight());
 }
 
 void LTexture::render2(int x, int y, int width, int height)
 {
+    //Off-screen copies are skipped, so their textures count as not drawn and can be evicted
+    if (x >= SCREEN_WIDTH || y >= SCREEN_HEIGHT || x + width <= 0 || y + height <= 0)
+    {
+        return;
+    }
+
     //Set rendering space and render1 to screen
     SDL_Rect renderQuad = { x, y, width, height };
-    SDL_RenderCopy(gRenderer, mTexture, NULL, &renderQuad);
+    SDL_RenderCopy(gRenderer, getTexture(), NULL, &renderQuad);
+}
+
+SDL_Texture* LTexture::getTexture()
+{
+    //Cached textures may have been evicted since the last draw
+    return mCacheEntry != nullptr ? gTextureCache.use(mCacheEntry) : mTexture;
 }
 
 int LTexture::getWidth() const {
-    return mWidth;
+    //A reloaded image may have changed size
+    return mCacheEntry != nullptr ? mCacheEntry->width : mWidth;
 }
 
 int LTexture::getHeight() const {
-    return mHeight;
+    return mCacheEntry != nullptr ? mCacheEntry->height : mHeight;
 }
 
 Player::Player(float x_pos, float y_pos, std::string tex, KEYVARIANTS keyVar)
@@ -705,86 +1481,147 @@ void Player::updateOldPoints() {
     oldPoints = activePoints;
 }
 
-Level::Level(std::string map) {
-    std::vector<int> line;
-    availablePositions.clear();
-    for (int j = 0; j < levelMapHeight; j++) {
-        for (int i = 0; i < levelMapWidth; i++) {
-            switch (map[j * levelMapWidth + i])
-            {
-                case '#':
-                    levelWalls.push_back(new Wall(i * map_tile_size, j * map_tile_size, map_tile_size, map_tile_size));
-                    line.push_back(UNAVAILABLE);
-                    break;
-                case 'o':
-                    levelWalls.push_back(new Wall(i * map_tile_size, j * map_tile_size, map_tile_size, map_tile_size));
-                    levelWalls.back()->texture.loadFromFile("../level/target.png");
-                    star = levelWalls.back();
-                    line.push_back(UNAVAILABLE);
-                    levelWalls.back()->isTarget = true;
-                    break;
-                default:
-                    std::cout << "Available position detected: " << i << ", " << j << ")" << std::endl;
-                    line.push_back(AVAILABLE);
-                    break;
-            }
-        }
-        availablePositions.push_back(line);
-        line.clear();
-    }
+Level::Level(const char* tiles) {
+    target = nullptr;
+    loadNewMap(tiles);
 }
 
 Level::~Level() {
-    for(Wall* w : levelWalls) {
-        w->texture.free();
+    for (std::map<int, Chunk>::iterator it = chunks.begin(); it != chunks.end(); ++it) {
+        unloadChunk(it->second);
     }
+    delete target;
 }
 
-void Level::loadNewMap(std::string map) {
-    std::vector<int> line;
-    for (Wall* w : levelWalls) {
-        w->texture.free();
-        delete w;
+void Level::loadNewMap(const char* tiles) {
+    for (std::map<int, Chunk>::iterator it = chunks.begin(); it != chunks.end(); ++it) {
+        unloadChunk(it->second);
     }
-    levelWalls.clear();
-    availablePositions.clear();
-    for (int j = 0; j < levelMapHeight; j++) {
-        for (int i = 0; i < levelMapWidth; i++) {
-            switch (map[j * levelMapWidth + i])
-            {
-                case '#':
-                    levelWalls.push_back(new Wall(i * map_tile_size, j * map_tile_size, map_tile_size, map_tile_size));
-                    line.push_back(UNAVAILABLE);
-                    break;
-                case 'o':
-                    levelWalls.push_back(new Wall(i * map_tile_size, j * map_tile_size, map_tile_size, map_tile_size));
-                    levelWalls.back()->texture.loadFromFile("../level/target.png");
-                    star = levelWalls.back();
-                    line.push_back(UNAVAILABLE);
-                    levelWalls.back()->isTarget = true;
-                    break;
-                default:
-                    //std::cout << "Available position detected: " << i << ", " << j << ")" << std::endl;
-                    line.push_back(AVAILABLE);
-                    break;
+    chunks.clear();
+    delete target;
+    target = nullptr;
+    star = nullptr;
+    takenPositions.clear();
+
+    this->tiles = tiles;
+    chunkColumns = (levelMapWidth + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    chunkRows = (levelMapHeight + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
+    //Find the target once, a memchr over the map is far cheaper than building every chunk
+    const char* found = (const char*)std::memchr(tiles, 'o', size_t(levelMapWidth) * levelMapHeight);
+    if (found != nullptr) {
+        int i = (found - tiles) % levelMapWidth;
+        int j = (found - tiles) / levelMapWidth;
+        target = new Wall(i * map_tile_size, j * map_tile_size, map_tile_size, map_tile_size);
+        target->texture.loadFromFile("../level/target.png", map_tile_size, map_tile_size);
+        target->isTarget = true;
+        star = target;
+    }
+}
+
+void Level::update(float init_x, float init_y) {
+    //Chunks under the screen plus a margin, so walking into the next one never shows it being built
+    float chunkPixels = CHUNK_SIZE * map_tile_size;
+    int firstColumn = std::max(0, int(std::floor(init_x / chunkPixels)) - CHUNK_MARGIN);
+    int lastColumn = std::min(chunkColumns - 1, int(std::floor((init_x + SCREEN_WIDTH) / chunkPixels)) + CHUNK_MARGIN);
+    int firstRow = std::max(0, int(std::floor(init_y / chunkPixels)) - CHUNK_MARGIN);
+    int lastRow = std::min(chunkRows - 1, int(std::floor((init_y + SCREEN_HEIGHT) / chunkPixels)) + CHUNK_MARGIN);
+
+    for (std::map<int, Chunk>::iterator it = chunks.begin(); it != chunks.end(); ) {
+        int column = it->first % chunkColumns;
+        int row = it->first / chunkColumns;
+        if (column < firstColumn || column > lastColumn || row < firstRow || row > lastRow) {
+            unloadChunk(it->second);
+            it = chunks.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    for (int row = firstRow; row <= lastRow; row++) {
+        for (int column = firstColumn; column <= lastColumn; column++) {
+            int key = row * chunkColumns + column;
+            if (chunks.find(key) == chunks.end()) {
+                loadChunk(column, row, chunks[key]);
+            }
+        }
+    }
+}
+
+void Level::loadChunk(int column, int row, Chunk& chunk) {
+    chunk.grid.assign(CHUNK_SIZE * CHUNK_SIZE, nullptr);
+    int lastRow = std::min(levelMapHeight, (row + 1) * CHUNK_SIZE);
+    int lastColumn = std::min(levelMapWidth, (column + 1) * CHUNK_SIZE);
+    for (int j = row * CHUNK_SIZE; j < lastRow; j++) {
+        const char* line = tiles + size_t(j) * levelMapWidth;
+        for (int i = column * CHUNK_SIZE; i < lastColumn; i++) {
+            if (line[i] == '#') {
+                chunk.walls.push_back(new Wall(i * map_tile_size, j * map_tile_size, map_tile_size, map_tile_size));
+                chunk.grid[(j - row * CHUNK_SIZE) * CHUNK_SIZE + i - column * CHUNK_SIZE] = chunk.walls.back();
             }
         }
-        availablePositions.push_back(line);
-        line.clear();
     }
 }
 
+void Level::unloadChunk(Chunk& chunk) {
+    for (Wall* w : chunk.walls) {
+        delete w;
+    }
+    chunk.walls.clear();
+    chunk.grid.clear();
+}
+
 void Level::render(float init_x, float init_y) {
-    for (Wall* w : levelWalls) {
+    //The chunks in the margin around the screen are loaded but not drawn
+    queryWalls(init_x, init_y, SCREEN_WIDTH, SCREEN_HEIGHT, visibleWalls);
+    for (Wall* w : visibleWalls) {
         w->texture.render2(w->xp - init_x, w->yp - init_y, w->w, w->h);
-//        if(w->isTarget) {
-//            std::cout << ", star xp: " << w->xp << ", star yp: " << w->yp << std::endl;
-//        }
     }
 }
 
-std::vector<std::vector<int>> Level::getAvailablePositions() {
-    return availablePositions;
+bool Level::isAvailable(int column, int row) const {
+    if (column < 0 || row < 0 || column >= levelMapWidth || row >= levelMapHeight) {
+        return false;
+    }
+    char tile = tiles[size_t(row) * levelMapWidth + column];
+    size_t position = size_t(row) * levelMapWidth + column;
+    return tile != '#' && tile != 'o' && std::find(takenPositions.begin(), takenPositions.end(), position) == takenPositions.end();
+}
+
+void Level::takePosition(int column, int row) {
+    takenPositions.push_back(size_t(row) * levelMapWidth + column);
+}
+
+void Level::queryWalls(float x, float y, float w, float h, std::vector<Wall*>& walls) {
+    //Only the cells under the rectangle are visited, in the chunks that are loaded
+    walls.clear();
+    int firstColumn = std::max(0, int(std::floor(x / map_tile_size)));
+    int lastColumn = std::min(levelMapWidth - 1, int(std::floor((x + w) / map_tile_size)));
+    int firstRow = std::max(0, int(std::floor(y / map_tile_size)));
+    int lastRow = std::min(levelMapHeight - 1, int(std::floor((y + h) / map_tile_size)));
+    for (int chunkRow = firstRow / CHUNK_SIZE; chunkRow <= lastRow / CHUNK_SIZE && firstRow <= lastRow; chunkRow++) {
+        for (int chunkColumn = firstColumn / CHUNK_SIZE; chunkColumn <= lastColumn / CHUNK_SIZE && firstColumn <= lastColumn; chunkColumn++) {
+            std::map<int, Chunk>::iterator it = chunks.find(chunkRow * chunkColumns + chunkColumn);
+            if (it == chunks.end()) {
+                continue;
+            }
+            int top = std::max(firstRow, chunkRow * CHUNK_SIZE) - chunkRow * CHUNK_SIZE;
+            int bottom = std::min(lastRow, (chunkRow + 1) * CHUNK_SIZE - 1) - chunkRow * CHUNK_SIZE;
+            int left = std::max(firstColumn, chunkColumn * CHUNK_SIZE) - chunkColumn * CHUNK_SIZE;
+            int right = std::min(lastColumn, (chunkColumn + 1) * CHUNK_SIZE - 1) - chunkColumn * CHUNK_SIZE;
+            for (int j = top; j <= bottom; j++) {
+                for (int i = left; i <= right; i++) {
+                    Wall* wall = it->second.grid[j * CHUNK_SIZE + i];
+                    if (wall != nullptr) {
+                        walls.push_back(wall);
+                    }
+                }
+            }
+        }
+    }
+    if (target != nullptr && target->xp + target->w >= x && target->xp <= x + w && target->yp + target->h >= y && target->yp <= y + h) {
+        walls.push_back(target);
+    }
 }
 
 double distanceSquared( float x1, float y1, float x2, float y2 )
@@ -794,7 +1631,8 @@ double distanceSquared( float x1, float y1, float x2, float y2 )
     return deltaX*deltaX + deltaY*deltaY;
 }
 
-void checkCircularCollision(Player &circlePlayer, Wall* wall, Level &level, Player &player1)
+//Pushes the circle out of a wall it overlaps, returns true instead when the wall is the target
+bool checkCircularCollision(Player &circlePlayer, Wall* wall)
 {
     float circle_center_x = circlePlayer.getPosX() + circlePlayer.getPWidth() * 0.5;
     float circle_center_y = circlePlayer.getPosY() + circlePlayer.getPHeight() * 0.5;
@@ -834,9 +1672,7 @@ void checkCircularCollision(Player &circlePlayer, Wall* wall, Level &level, Play
 
     if(distanceSquared(circle_center_x, circle_center_y, cX, cY) < circle_radius * circle_radius){
         if (wall->isTarget){
-            player1.updateOldPoints();
-            circlePlayer.addPoint();
-            switchLevel(level, activeLevelMap, player1, circlePlayer);
+            return true;
         } else {
             float dist_to_circle_centerX = circle_center_x - cX;
             float dist_to_circle_centerY = circle_center_y - cY;
@@ -849,15 +1685,15 @@ void checkCircularCollision(Player &circlePlayer, Wall* wall, Level &level, Play
             circlePlayer.setPosition(resultX, resultY);
         }
     }
+    return false;
 }
 
-void checkRectangularCollision(Player &player1, Wall* w, Level &level, Player &player2){
+//Pushes the square out of a wall it touches, returns true instead when the wall is the target
+bool checkRectangularCollision(Player &player1, Wall* w){
     //left collisions
     if (int(player1.getPosX()) == w->xp + w->w && player1.getPosY() > w->yp - player1.getPHeight() && player1.getPosY() < w->yp + w->h) {
         if (w->isTarget){
-            player2.updateOldPoints();
-            player1.addPoint();
-            switchLevel(level, activeLevelMap, player1, player2);
+            return true;
         } else {
             player1.setPosition(w->xp + w->w + 1, player1.getPosY());
         }
@@ -865,9 +1701,7 @@ void checkRectangularCollision(Player &player1, Wall* w, Level &level, Player &p
     //right collision
     if (int(player1.getPosX() + player1.getPWidth()) == w->xp && player1.getPosY() > w->yp - player1.getPHeight() && player1.getPosY() < w->yp + w->h) {
         if (w->isTarget){
-            player2.updateOldPoints();
-            player1.addPoint();
-            switchLevel(level, activeLevelMap, player1, player2);
+            return true;
         } else {
             player1.setPosition(w->xp - player1.getPWidth() - 1, player1.getPosY());
         }
@@ -875,9 +1709,7 @@ void checkRectangularCollision(Player &player1, Wall* w, Level &level, Player &p
     //top collision
     if (int(player1.getPosY()) == w->yp + w->h && player1.getPosX() > w->xp - player1.getPWidth() && player1.getPosX() < w->xp + w->w) {
         if (w->isTarget){
-            player2.updateOldPoints();
-            player1.addPoint();
-            switchLevel(level, activeLevelMap, player1, player2);
+            return true;
         } else {
             player1.setPosition(player1.getPosX(), w->yp + w->h + 1);
         }
@@ -885,13 +1717,12 @@ void checkRectangularCollision(Player &player1, Wall* w, Level &level, Player &p
     //bottom collision
     if (int(player1.getPosY() + player1.getPHeight()) == w->yp && player1.getPosX() > w->xp - player1.getPWidth() && player1.getPosX() < w->xp + w->w) {
         if (w->isTarget){
-            player2.updateOldPoints();
-            player1.addPoint();
-            switchLevel(level, activeLevelMap, player1, player2);
+            return true;
         } else {
             player1.setPosition(player1.getPosX(), w->yp - player1.getPHeight() - 1);
         }
     }
+    return false;
 }
 
 void switchLevel(Level &level, std::string* &newMap, Player &player1, Player &player2){
@@ -927,8 +1758,18 @@ void switchLevel(Level &level, std::string* &newMap, Player &player1, Player &pl
         levelHasJustBeenChanged = true;
         newMap++;
     }
-    readLevelMap(map);
-    level.loadNewMap(levelMapString);
+    //The map was read in the background while the round was played, only a failed read is retried here
+    Uint64 switchBegin = SDL_GetPerformanceCounter();
+    std::unique_ptr<LevelMap> prefetched;
+    if (nextLevelMap.valid() && nextLevelMapPath == map) {
+        prefetched = nextLevelMap.get();
+    }
+    if (prefetched != nullptr) {
+        useLevelMap(std::move(prefetched));
+    } else {
+        readLevelMap(map);
+    }
+    level.loadNewMap(levelMapTiles);
 
     float p1NewX = 0;
     float p1NewY = 0;
@@ -941,6 +1782,11 @@ void switchLevel(Level &level, std::string* &newMap, Player &player1, Player &pl
 
     camera_x = 0.0f;
     camera_y = 0.0f;
+
+    //Build the first chunks now, then start reading the map after this one
+    level.update(camera_x, camera_y);
+    printf("Level switch: %.2f ms\n", (SDL_GetPerformanceCounter() - switchBegin) * 1000.0 / SDL_GetPerformanceFrequency());
+    prefetchLevelMap(*newMap);
 }
 
 void generateRandomPositions(float &x, float &y, Level &level) {
@@ -948,10 +1794,10 @@ void generateRandomPositions(float &x, float &y, Level &level) {
     int range2 = rand() % 3 + 3;
     for (int i = range1; i > 0; i--) {
         for (int j = range2; j > 0; j--) {
-            if(level.getAvailablePositions()[i][j] == AVAILABLE){
+            if(level.isAvailable(j, i)){
                 x = j * map_tile_size + 0.25 * map_tile_size;
                 y = i * map_tile_size + 0.25 * map_tile_size;
-                level.getAvailablePositions()[i][j] = UNAVAILABLE;
+                level.takePosition(j, i);
                 return;
             }
         }
@@ -971,6 +1817,9 @@ void renderOldScore(Player &player1, Player &player2){
 }
 
 void renderStar(Player &player1, Player &player2) {
+    if (star == nullptr) {
+        return;
+    }
 
     if(!(star->xp > camera_x - star->w &&
          star->xp < camera_x + SCREEN_WIDTH &&
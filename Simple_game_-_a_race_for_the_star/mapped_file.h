@@ -0,0 +1,141 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstdio>
+#include <string>
+#include <sys/stat.h>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+//A file mapped read-only into memory, shared by the game and level_benchmark so the benchmark times the same loads.
+//Pages are read from disk when they are first touched
+class LMappedFile
+{
+public:
+    //Initializes variables
+    LMappedFile();
+
+    //Unmaps the file
+    ~LMappedFile();
+
+    //Maps the file at path read-only, false when it cannot be mapped
+    bool open(std::string path);
+
+    //Unmaps the file
+    void close();
+
+    //The mapped bytes
+    const char* getData() const {return mData;}
+    size_t getSize() const {return mSize;}
+
+private:
+    const char* mData;
+    size_t mSize;
+#ifdef _WIN32
+    HANDLE mFile;
+    HANDLE mMapping;
+#endif
+};
+
+inline LMappedFile::LMappedFile()
+{
+    //Initialize
+    mData = nullptr;
+    mSize = 0;
+#ifdef _WIN32
+    mFile = INVALID_HANDLE_VALUE;
+    mMapping = NULL;
+#endif
+}
+
+inline LMappedFile::~LMappedFile()
+{
+    close();
+}
+
+inline bool LMappedFile::open(std::string path)
+{
+    //Get rid of a preexisting mapping
+    close();
+
+#ifdef _WIN32
+    mFile = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (mFile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    if (GetFileSizeEx(mFile, &fileSize) && fileSize.QuadPart > 0)
+    {
+        mMapping = CreateFileMappingA(mFile, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mMapping != NULL)
+        {
+            mData = (const char*)MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+            mSize = fileSize.QuadPart;
+        }
+    }
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0)
+    {
+        void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED)
+        {
+            mData = (const char*)mapping;
+            mSize = info.st_size;
+        }
+    }
+    //The mapping stays valid without the descriptor
+    ::close(fd);
+#endif
+
+    if (mData == nullptr)
+    {
+        printf("Unable to map %s!\n", path.c_str());
+        close();
+        return false;
+    }
+    return true;
+}
+
+inline void LMappedFile::close()
+{
+#ifdef _WIN32
+    if (mData != nullptr)
+    {
+        UnmapViewOfFile(mData);
+    }
+    if (mMapping != NULL)
+    {
+        CloseHandle(mMapping);
+        mMapping = NULL;
+    }
+    if (mFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(mFile);
+        mFile = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (mData != nullptr)
+    {
+        munmap((void*)mData, mSize);
+    }
+#endif
+    mData = nullptr;
+    mSize = 0;
+}
+
+#endif
@@ -0,0 +1,140 @@
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include "native_format.h"
+
+//Measures where the pixel format conversion of a texture is paid. SDL_CreateTextureFromSurface converts a surface
+//that isn't in the texture's format while uploading, on the thread that owns the renderer; the game converts with
+//convertToNativeFormat on the loader workers instead, so only an upload without conversion is left for the main thread.
+//Both ways end in a texture of the same format, the blits afterwards cost the same.
+//Usage: upload_benchmark [uploads per run] <image>...
+//Uploads to the software renderer of an offscreen surface, so it also runs on machines without a display
+
+const int TARGET_WIDTH = 1280;
+const int TARGET_HEIGHT = 720;
+
+SDL_Surface* loadKeyed(std::string path);
+double measureUploads(SDL_Renderer* renderer, SDL_Surface* surface, int uploads);
+double measureConversions(SDL_Surface* surface, const SDL_RendererInfo& info, int conversions);
+
+int main(int argc, char* args[])
+{
+    int first = 1;
+    int uploads = 200;
+    if (argc > 1 && std::atoi(args[1]) > 0)
+    {
+        uploads = std::atoi(args[1]);
+        first++;
+    }
+    if (argc - first < 1)
+    {
+        printf("Usage: upload_benchmark [uploads per run] <image>...\n");
+        return 1;
+    }
+
+    //Initialize PNG loading
+    int imgFlags = IMG_INIT_PNG;
+    if (!(IMG_Init(imgFlags) & imgFlags))
+    {
+        printf("SDL_image could not initialize! SDL_image Error: %s\n", IMG_GetError());
+        return 1;
+    }
+
+    //Same layout as a typical window surface
+    SDL_Surface* target = SDL_CreateRGBSurfaceWithFormat(0, TARGET_WIDTH, TARGET_HEIGHT, 32, SDL_PIXELFORMAT_RGB888);
+    SDL_Renderer* renderer = target == nullptr ? nullptr : SDL_CreateSoftwareRenderer(target);
+    if (renderer == nullptr)
+    {
+        printf("Software renderer could not be created! SDL Error: %s\n", SDL_GetError());
+        IMG_Quit();
+        return 1;
+    }
+    SDL_RendererInfo info;
+    SDL_GetRendererInfo(renderer, &info);
+
+    printf("%-28s %-22s %16s %16s %16s\n", "image", "format", "upload decoded", "convert", "upload converted");
+    for (int i = first; i < argc; i++)
+    {
+        SDL_Surface* loaded = loadKeyed(args[i]);
+        SDL_Surface* native = loaded == nullptr ? nullptr : convertToNativeFormat(SDL_DuplicateSurface(loaded), info);
+        if (loaded == nullptr || native == nullptr)
+        {
+            SDL_FreeSurface(loaded);
+            SDL_FreeSurface(native);
+            continue;
+        }
+
+        //Upload decoded: the surface as IMG_Load returned it, convert and upload converted: the game's way
+        std::string formats = std::string(SDL_GetPixelFormatName(loaded->format->format) + 16) + " -> " +
+                              (SDL_GetPixelFormatName(native->format->format) + 16);
+        double decoded = measureUploads(renderer, loaded, uploads);
+        double conversion = measureConversions(loaded, info, uploads);
+        double converted = measureUploads(renderer, native, uploads);
+        if (decoded >= 0.0 && conversion >= 0.0 && converted >= 0.0)
+        {
+            printf("%-28s %-22s %13.3f ms %13.3f ms %13.3f ms\n", args[i], formats.c_str(), decoded, conversion, converted);
+        }
+        else
+        {
+            printf("Unable to measure %s! SDL Error: %s\n", args[i], SDL_GetError());
+        }
+
+        SDL_FreeSurface(loaded);
+        SDL_FreeSurface(native);
+    }
+    printf("Milliseconds per texture, averaged over %d runs; the game pays convert on a loader worker and upload converted on the main thread\n", uploads);
+
+    SDL_DestroyRenderer(renderer);
+    SDL_FreeSurface(target);
+    IMG_Quit();
+    return 0;
+}
+
+SDL_Surface* loadKeyed(std::string path)
+{
+    //Load and color key the image the way decodeSurface does before converting
+    SDL_Surface* loadedSurface = IMG_Load(path.c_str());
+    if (loadedSurface == nullptr)
+    {
+        printf("Unable to load image %s! SDL_image Error: %s\n", path.c_str(), IMG_GetError());
+        return nullptr;
+    }
+    SDL_SetColorKey(loadedSurface, SDL_TRUE | SDL_RLEACCEL, SDL_MapRGB(loadedSurface->format, 0xFF, 0x11, 0x17));
+    return loadedSurface;
+}
+
+double measureUploads(SDL_Renderer* renderer, SDL_Surface* surface, int uploads)
+{
+    Uint64 start = SDL_GetPerformanceCounter();
+    for (int i = 0; i < uploads; i++)
+    {
+        SDL_Texture* texture = SDL_CreateTextureFromSurface(renderer, surface);
+        if (texture == nullptr)
+        {
+            return -1.0;
+        }
+        SDL_DestroyTexture(texture);
+    }
+    return double(SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency() / uploads;
+}
+
+double measureConversions(SDL_Surface* surface, const SDL_RendererInfo& info, int conversions)
+{
+    //Each run converts a fresh copy, convertToNativeFormat frees the surface it is given; only the conversion is timed
+    Uint64 elapsed = 0;
+    for (int i = 0; i < conversions; i++)
+    {
+        SDL_Surface* copy = SDL_DuplicateSurface(surface);
+        if (copy == nullptr)
+        {
+            return -1.0;
+        }
+        Uint64 start = SDL_GetPerformanceCounter();
+        SDL_Surface* converted = convertToNativeFormat(copy, info);
+        elapsed += SDL_GetPerformanceCounter() - start;
+        SDL_FreeSurface(converted);
+    }
+    return double(elapsed) * 1000.0 / SDL_GetPerformanceFrequency() / conversions;
+}
@@ -0,0 +1,159 @@
+#ifndef ASYNC_LOADER_H
+#define ASYNC_LOADER_H
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+
+//Decodes the image read from source and color keys it, keyed sprites are run-length encoded. source is closed,
+//path only names the image in errors. Safe to call from any thread
+inline SDL_Surface* loadKeyedSurface(SDL_RWops* source, std::string path)
+{
+    SDL_Surface* loadedSurface = IMG_Load_RW(source, 1);
+    if (loadedSurface == nullptr)
+    {
+        printf("Unable to load image %s! SDL_image Error: %s\n", path.c_str(), IMG_GetError());
+        return nullptr;
+    }
+    SDL_SetColorKey(loadedSurface, SDL_TRUE | SDL_RLEACCEL, SDL_MapRGB(loadedSurface->format, 0xFF, 0x11, 0x17));
+    return loadedSurface;
+}
+
+//Resamples surface to width x height and frees it, surface itself is returned when no size is given or it already fits
+inline SDL_Surface* scaleSurface(SDL_Surface* surface, int width, int height)
+{
+    if (surface == nullptr || width <= 0 || height <= 0 || (surface->w == width && surface->h == height))
+    {
+        return surface;
+    }
+
+    //Nearest neighbour, the same filter the renderer used when it scaled the tiles every frame
+    SDL_Surface* scaled = SDL_CreateRGBSurfaceWithFormat(0, width, height, surface->format->BitsPerPixel, surface->format->format);
+    if (scaled == nullptr)
+    {
+        printf("Unable to create %dx%d surface! SDL Error: %s\n", width, height, SDL_GetError());
+        return surface;
+    }
+    Uint32 key;
+    if (SDL_GetColorKey(surface, &key) == 0)
+    {
+        SDL_SetColorKey(scaled, SDL_TRUE, key);
+    }
+    SDL_SetSurfaceBlendMode(surface, SDL_BLENDMODE_NONE);
+    SDL_BlitScaled(surface, NULL, scaled, NULL);
+
+    SDL_FreeSurface(surface);
+    return scaled;
+}
+
+//Decodes images on a pool of worker threads, one per core. Only the surfaces are made off the render thread,
+//the caller uploads them once their futures are ready
+class LAsyncLoader
+{
+public:
+    //decode turns a path into a surface and runs on the workers, so it must not touch the renderer
+    explicit LAsyncLoader(std::function<SDL_Surface*(std::string path)> decode);
+
+    //Finishes queued jobs and joins the workers
+    ~LAsyncLoader();
+
+    //Decodes the image at path on a worker thread, resampled to width x height when a size is given
+    std::future<SDL_Surface*> loadSurface(std::string path, int width = 0, int height = 0);
+
+    //Queues any other surface job, the workers are started on first use
+    std::future<SDL_Surface*> submit(std::function<SDL_Surface*()> job);
+
+    //Finishes queued jobs and joins the workers
+    void stop();
+
+private:
+    //Runs queued jobs until stopped
+    void work();
+
+    std::function<SDL_Surface*(std::string path)> decode;
+    std::vector<std::thread> workers;
+    std::deque<std::packaged_task<SDL_Surface*()>> jobs;
+    std::mutex jobsMutex;
+    std::condition_variable jobsReady;
+    bool stopping = false;
+};
+
+inline LAsyncLoader::LAsyncLoader(std::function<SDL_Surface*(std::string path)> decode)
+    : decode(decode)
+{
+}
+
+inline LAsyncLoader::~LAsyncLoader()
+{
+    stop();
+}
+
+inline std::future<SDL_Surface*> LAsyncLoader::loadSurface(std::string path, int width, int height)
+{
+    return submit([this, path, width, height]() { return scaleSurface(decode(path), width, height); });
+}
+
+inline void LAsyncLoader::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        stopping = true;
+    }
+    jobsReady.notify_all();
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+    workers.clear();
+    stopping = false;
+}
+
+inline std::future<SDL_Surface*> LAsyncLoader::submit(std::function<SDL_Surface*()> job)
+{
+    std::packaged_task<SDL_Surface*()> task(job);
+    std::future<SDL_Surface*> result = task.get_future();
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        jobs.push_back(std::move(task));
+        if (workers.empty())
+        {
+            unsigned int count = std::max(1u, std::thread::hardware_concurrency());
+            for (unsigned int i = 0; i < count; i++)
+            {
+                workers.push_back(std::thread(&LAsyncLoader::work, this));
+            }
+        }
+    }
+    jobsReady.notify_one();
+    return result;
+}
+
+inline void LAsyncLoader::work()
+{
+    while (true)
+    {
+        std::packaged_task<SDL_Surface*()> task;
+        {
+            std::unique_lock<std::mutex> lock(jobsMutex);
+            jobsReady.wait(lock, [this]() { return stopping || !jobs.empty(); });
+            if (jobs.empty())
+            {
+                return;
+            }
+            task = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        task();
+    }
+}
+
+#endif
@@ -0,0 +1,169 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include <SDL2/SDL.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <time.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+//Reports watched files that were written, for reloading assets while the game runs. Uses inotify on Linux and
+//compares modification times elsewhere
+class LFileWatcher
+{
+public:
+    LFileWatcher();
+
+    //Stops watching
+    ~LFileWatcher();
+
+    //Starts watching the file at path for changes
+    void watch(std::string path);
+
+    //Collects the watched files written since the last call, returns false when nothing changed
+    bool poll(std::vector<std::string>& changed);
+
+private:
+    struct File
+    {
+        std::string path;
+        time_t modified = 0;
+    };
+
+    //Modification time of path, 0 when it does not exist
+    static time_t modifiedTime(std::string path);
+
+    std::vector<File> files;
+
+    //Without inotify the modification times are compared every POLL_INTERVAL milliseconds
+    static const Uint32 POLL_INTERVAL = 500;
+    Uint32 lastPoll = 0;
+
+#ifdef __linux__
+    //Directories of the watched files by watch descriptor, editors often replace a file instead of writing it
+    int mInotify = -1;
+    std::map<int, std::string> directories;
+#endif
+};
+
+inline LFileWatcher::LFileWatcher()
+{
+#ifdef __linux__
+    mInotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (mInotify < 0)
+    {
+        printf("Unable to start inotify, polling file times instead!\n");
+    }
+#endif
+}
+
+inline LFileWatcher::~LFileWatcher()
+{
+#ifdef __linux__
+    if (mInotify >= 0)
+    {
+        ::close(mInotify);
+    }
+#endif
+}
+
+inline void LFileWatcher::watch(std::string path)
+{
+    File file;
+    file.path = path;
+    file.modified = modifiedTime(path);
+    files.push_back(file);
+
+#ifdef __linux__
+    if (mInotify < 0)
+    {
+        return;
+    }
+    size_t slash = path.find_last_of('/');
+    std::string directory = slash == std::string::npos ? "." : path.substr(0, slash);
+    for (std::map<int, std::string>::iterator it = directories.begin(); it != directories.end(); ++it)
+    {
+        if (it->second == directory)
+        {
+            return;
+        }
+    }
+    int descriptor = inotify_add_watch(mInotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (descriptor < 0)
+    {
+        printf("Unable to watch %s!\n", directory.c_str());
+        return;
+    }
+    directories[descriptor] = directory;
+#endif
+}
+
+inline bool LFileWatcher::poll(std::vector<std::string>& changed)
+{
+    changed.clear();
+
+#ifdef __linux__
+    if (mInotify >= 0)
+    {
+        //Drain the queued events without blocking, several writes to one file count once
+        alignas(inotify_event) char buffer[4096];
+        ssize_t length;
+        while ((length = read(mInotify, buffer, sizeof(buffer))) > 0)
+        {
+            for (char* next = buffer; next < buffer + length; next += sizeof(inotify_event) + ((inotify_event*)next)->len)
+            {
+                inotify_event* event = (inotify_event*)next;
+                if (event->len == 0 || directories.find(event->wd) == directories.end())
+                {
+                    continue;
+                }
+                std::string path = directories[event->wd] + "/" + event->name;
+                for (const File& file : files)
+                {
+                    if (file.path == path && std::find(changed.begin(), changed.end(), path) == changed.end())
+                    {
+                        changed.push_back(path);
+                    }
+                }
+            }
+        }
+        return !changed.empty();
+    }
+#endif
+
+    //Fall back to comparing modification times a couple of times per second
+    if (SDL_GetTicks() - lastPoll < POLL_INTERVAL)
+    {
+        return false;
+    }
+    lastPoll = SDL_GetTicks();
+    for (File& file : files)
+    {
+        time_t modified = modifiedTime(file.path);
+        if (modified != file.modified)
+        {
+            file.modified = modified;
+            changed.push_back(file.path);
+        }
+    }
+    return !changed.empty();
+}
+
+inline time_t LFileWatcher::modifiedTime(std::string path)
+{
+    struct stat status;
+    if (stat(path.c_str(), &status) != 0)
+    {
+        return 0;
+    }
+    return status.st_mtime;
+}
+
+#endif
@@ -0,0 +1,219 @@
+#ifndef LEVEL_CACHE_H
+#define LEVEL_CACHE_H
+
+#include <SDL2/SDL.h>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <functional>
+#include <sys/stat.h>
+#include "tile_draw_list.h"
+
+//Layout of a level cache file: LevelCacheHeader, then itemCount items of itemSize bytes and height + 1 row starts.
+//The items of row j are items[rowStart[j]] up to items[rowStart[j + 1]]
+struct LevelCacheHeader
+{
+    char magic[4];
+    Uint32 version;
+    Uint64 assetsKey;
+    Uint64 textKey;
+    Uint64 sourceSize;
+    Sint64 sourceModified;
+    Sint32 width;
+    Sint32 height;
+    Uint32 itemCount;
+    Uint32 itemSize;
+};
+
+const char LEVEL_CACHE_MAGIC[4] = { 'L', 'V', 'C', 'H' };
+const Uint32 LEVEL_CACHE_VERSION = 2;
+
+//What a cache was built from. The size and modification time of the map are compared first and its text is only
+//hashed when they differ, so a map that wasn't touched isn't read at all. assetsKey stands for everything else the
+//items depend on, such as the tile list and the version of the code that builds them
+struct LevelCacheSource
+{
+    Uint64 size = 0;
+    Sint64 modified = 0;
+    Uint64 assetsKey = 0;
+    Uint64 textKey = 0;
+};
+
+//64 bit FNV-1a, pass the previous hash to continue it over more bytes
+inline Uint64 hashBytes(const char* data, size_t size, Uint64 hash = 14695981039346656037ULL)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ (unsigned char)data[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+//assetsKey of a draw list indexing into tiles, bump version whenever the draw list is built differently
+inline Uint64 levelTilesKey(const std::vector<std::string>& tiles, Uint32 version)
+{
+    Uint64 key = hashBytes((const char*)&version, sizeof(version));
+    for (const std::string& tile : tiles)
+    {
+        key = hashBytes(tile.c_str(), tile.size() + 1, key);
+    }
+    return key;
+}
+
+//Size and modification time of the file at path, left at zero when it can't be read
+inline LevelCacheSource levelCacheSource(std::string path, Uint64 assetsKey)
+{
+    LevelCacheSource source;
+    source.assetsKey = assetsKey;
+    struct stat status;
+    if (stat(path.c_str(), &status) == 0)
+    {
+        source.size = status.st_size;
+        source.modified = status.st_mtime;
+    }
+    return source;
+}
+
+//Checks that the row starts partition itemCount items in order
+inline bool isValidRowStart(const std::vector<int>& rowStart, size_t itemCount)
+{
+    if (rowStart.empty() || rowStart.front() != 0 || rowStart.back() != (int)itemCount)
+    {
+        return false;
+    }
+    for (size_t j = 0; j + 1 < rowStart.size(); j++)
+    {
+        if (rowStart[j] > rowStart[j + 1])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+//Checks a draw list with valid row starts the way the game relies on it: every draw sits in its row in increasing
+//column order inside the map, and every tile is one of tileCount atlas tiles
+inline bool isValidDrawList(const std::vector<TileDraw>& drawList, const std::vector<int>& rowStart, int width, int tileCount)
+{
+    for (size_t j = 0; j + 1 < rowStart.size(); j++)
+    {
+        for (int d = rowStart[j]; d < rowStart[j + 1]; d++)
+        {
+            const TileDraw& draw = drawList[d];
+            if (draw.row != (int)j || draw.column < 0 || draw.column >= width || draw.tile < 0 || draw.tile >= tileCount ||
+                (d > rowStart[j] && draw.column <= drawList[d - 1].column))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+//Writes the cache next to path and renames it over the old one, so a cache is either whole or missing.
+//Without a cache the map is simply built again on the next start
+template <typename Item>
+inline void writeLevelCache(std::string path, const LevelCacheSource& source, const std::vector<Item>& items,
+                            const std::vector<int>& rowStart, int width, int height)
+{
+    LevelCacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, LEVEL_CACHE_MAGIC, sizeof(header.magic));
+    header.version = LEVEL_CACHE_VERSION;
+    header.assetsKey = source.assetsKey;
+    header.textKey = source.textKey;
+    header.sourceSize = source.size;
+    header.sourceModified = source.modified;
+    header.width = width;
+    header.height = height;
+    header.itemCount = items.size();
+    header.itemSize = sizeof(Item);
+
+    std::string temporary = path + ".tmp";
+    FILE* file = fopen(temporary.c_str(), "wb");
+    if (file == nullptr)
+    {
+        printf("Unable to write %s!\n", temporary.c_str());
+        return;
+    }
+    bool success = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   (items.empty() || fwrite(items.data(), sizeof(Item), items.size(), file) == items.size()) &&
+                   fwrite(rowStart.data(), sizeof(int), rowStart.size(), file) == rowStart.size();
+    success = fclose(file) == 0 && success;
+#ifdef _WIN32
+    //rename doesn't replace an existing file on Windows
+    std::remove(path.c_str());
+#endif
+    if (!success || std::rename(temporary.c_str(), path.c_str()) != 0)
+    {
+        printf("Unable to write %s!\n", path.c_str());
+        std::remove(temporary.c_str());
+    }
+}
+
+//Reads the items cached at path for source, false when there is none, it was built from other assets or text, or it
+//is damaged; items and rowStart are left empty then. textKey hashes the map text and is only called when the size or
+//time of the map changed since the cache was written, source.textKey holds the hash afterwards whenever it was known.
+//isValid(items, rowStart, width) checks the items once the row starts are known to be sound
+template <typename Item, typename IsValid>
+inline bool readLevelCache(std::string path, LevelCacheSource& source, std::function<Uint64()> textKey,
+                           std::vector<Item>& items, std::vector<int>& rowStart, int& width, int& height, IsValid isValid)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    //The sizes in the header must add up to the file before anything is allocated for them
+    LevelCacheHeader header;
+    bool hit = fread(&header, sizeof(header), 1, file) == 1 &&
+               std::memcmp(header.magic, LEVEL_CACHE_MAGIC, sizeof(header.magic)) == 0 &&
+               header.version == LEVEL_CACHE_VERSION && header.assetsKey == source.assetsKey &&
+               header.itemSize == sizeof(Item) && header.width >= 0 && header.height >= 0 &&
+               Uint64(size) == sizeof(header) + Uint64(header.itemCount) * sizeof(Item) + (Uint64(header.height) + 1) * sizeof(int);
+
+    //A map that was only touched or checked out again still matches by its text
+    bool sameFile = source.modified != 0 && header.sourceSize == source.size && header.sourceModified == source.modified;
+    if (hit && sameFile)
+    {
+        source.textKey = header.textKey;
+    }
+    else if (hit)
+    {
+        source.textKey = textKey();
+        hit = header.textKey == source.textKey;
+    }
+
+    if (hit)
+    {
+        items.resize(header.itemCount);
+        rowStart.resize(size_t(header.height) + 1);
+        hit = (items.empty() || fread(items.data(), sizeof(Item), items.size(), file) == items.size()) &&
+              fread(rowStart.data(), sizeof(int), rowStart.size(), file) == rowStart.size() &&
+              isValidRowStart(rowStart, items.size()) && isValid(items, rowStart, header.width);
+    }
+    fclose(file);
+
+    if (!hit)
+    {
+        items.clear();
+        rowStart.assign(1, 0);
+        return false;
+    }
+    width = header.width;
+    height = header.height;
+
+    //Stamped again, so the next start doesn't hash the text either
+    if (!sameFile)
+    {
+        writeLevelCache(path, source, items, rowStart, width, height);
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef NATIVE_FORMAT_H
+#define NATIVE_FORMAT_H
+
+#include <SDL2/SDL.h>
+#include <cstdio>
+
+//Converts a decoded surface to the texture format the renderer prefers, so neither the upload nor the blits
+//have to convert pixels. A color key turns into transparent alpha and keyed sprites stay run-length encoded.
+//The surface passed in is freed when a converted copy is returned.
+inline SDL_Surface* convertToNativeFormat(SDL_Surface* surface, const SDL_RendererInfo& info)
+{
+    if (surface == nullptr)
+    {
+        return nullptr;
+    }
+
+    //Color keyed and translucent images need a format with an alpha channel
+    Uint32 key;
+    bool keyed = SDL_GetColorKey(surface, &key) == 0;
+    bool needAlpha = keyed || surface->format->Amask != 0;
+
+    //The renderer lists its formats best first
+    Uint32 format = SDL_PIXELFORMAT_UNKNOWN;
+    for (Uint32 i = 0; i < info.num_texture_formats; i++)
+    {
+        if (!SDL_ISPIXELFORMAT_FOURCC(info.texture_formats[i]) && (SDL_ISPIXELFORMAT_ALPHA(info.texture_formats[i]) != 0) == needAlpha)
+        {
+            format = info.texture_formats[i];
+            break;
+        }
+    }
+    if (format == SDL_PIXELFORMAT_UNKNOWN || format == surface->format->format)
+    {
+        return surface;
+    }
+
+    SDL_Surface* converted = SDL_ConvertSurfaceFormat(surface, format, 0);
+    if (converted == nullptr)
+    {
+        printf("Unable to convert surface to %s! SDL Error: %s\n", SDL_GetPixelFormatName(format), SDL_GetError());
+        return surface;
+    }
+    if (keyed)
+    {
+        SDL_SetSurfaceRLE(converted, 1);
+    }
+
+    SDL_FreeSurface(surface);
+    return converted;
+}
+
+#endif
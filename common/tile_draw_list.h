@@ -0,0 +1,57 @@
+#ifndef TILE_DRAW_LIST_H
+#define TILE_DRAW_LIST_H
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+//A tile of the level map with the atlas tile it draws, compiled once when the map is loaded
+struct TileDraw
+{
+    int tile;
+    int column;
+    int row;
+};
+
+//Calls draw(tileDraw, x, y) for the tiles of a draw list that are in the rectangle at regionX, regionY of size
+//regionWidth x regionHeight on screen, plus a one tile margin around it. The draws of row j are drawList[rowStart[j]]
+//up to drawList[rowStart[j + 1]], sorted by column. init_x and init_y offset the map on screen, the same as the map's
+//position relative to the camera. Only the rows under the rectangle are visited and each row is binary searched for
+//its first column under it, so the cost depends on the size of the rectangle, not on the size of the map
+template <typename Draw>
+inline void forEachTileInRegion(const std::vector<TileDraw>& drawList, const std::vector<int>& rowStart,
+                                float init_x, float init_y, float tile_w, float tile_h,
+                                int regionX, int regionY, int regionWidth, int regionHeight, Draw draw)
+{
+    if (tile_w <= 0 || tile_h <= 0 || rowStart.size() < 2)
+    {
+        return;
+    }
+    int rows = rowStart.size() - 1;
+    int firstRow = std::max(0, (int)std::floor((regionY - init_y) / tile_h) - 1);
+    int lastRow = std::min(rows - 1, (int)std::floor((regionY + regionHeight - init_y) / tile_h) + 1);
+    int firstColumn = (int)std::floor((regionX - init_x) / tile_w) - 1;
+    int lastColumn = (int)std::floor((regionX + regionWidth - init_x) / tile_w) + 1;
+    for (int j = firstRow; j <= lastRow; j++)
+    {
+        const TileDraw* begin = drawList.data() + rowStart[j];
+        const TileDraw* end = drawList.data() + rowStart[j + 1];
+        const TileDraw* tile = std::lower_bound(begin, end, firstColumn,
+                                                [](const TileDraw& d, int column) { return d.column < column; });
+        for (; tile != end && tile->column <= lastColumn; tile++)
+        {
+            draw(*tile, tile->column * tile_w + init_x, tile->row * tile_h + init_y);
+        }
+    }
+}
+
+//forEachTileInRegion over a whole screenWidth x screenHeight screen
+template <typename Draw>
+inline void forEachVisibleTile(const std::vector<TileDraw>& drawList, const std::vector<int>& rowStart,
+                               float init_x, float init_y, float tile_w, float tile_h,
+                               int screenWidth, int screenHeight, Draw draw)
+{
+    forEachTileInRegion(drawList, rowStart, init_x, init_y, tile_w, tile_h, 0, 0, screenWidth, screenHeight, draw);
+}
+
+#endif
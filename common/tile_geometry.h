@@ -0,0 +1,115 @@
+#ifndef TILE_GEOMETRY_H
+#define TILE_GEOMETRY_H
+
+#include <SDL2/SDL.h>
+#include <vector>
+#include <cmath>
+#include "tile_draw_list.h"
+
+//The quads of a level map's draw list against its tile atlas, built once when the map and atlas are loaded, so the
+//tiles on screen go out in one SDL_RenderGeometry call instead of one copy each. Positions are corners of a unit
+//tile, so the same quads serve any tile size; needs SDL 2.0.18 or newer to draw
+class LTileGeometry
+{
+public:
+    //Builds four vertices per draw in draw list order, clips are the tiles' source rectangles in the atlas
+    void build(const std::vector<TileDraw>& drawList, const std::vector<SDL_Rect>& clips, int atlasWidth, int atlasHeight);
+
+    //Drops the quads, render draws nothing until the next build
+    void clear();
+
+    //Draws the tiles under the rectangle at regionX, regionY of size regionWidth x regionHeight on screen with one
+    //SDL_RenderGeometry call, culled the same as forEachTileInRegion. Adds the calls made to drawCalls, false when
+    //the quads weren't built for this draw list or the renderer can't draw geometry
+    bool render(SDL_Renderer* renderer, SDL_Texture* atlas, const std::vector<TileDraw>& drawList, const std::vector<int>& rowStart,
+                float init_x, float init_y, float tile_w, float tile_h,
+                int regionX, int regionY, int regionWidth, int regionHeight, int& drawCalls);
+
+private:
+    std::vector<SDL_Vertex> vertices;
+
+    //Six indices per quad, the same for any run of quads packed from the front of translated
+    std::vector<int> indices;
+
+    //Reused every frame for the quads on screen moved into place
+    std::vector<SDL_Vertex> translated;
+};
+
+inline void LTileGeometry::build(const std::vector<TileDraw>& drawList, const std::vector<SDL_Rect>& clips, int atlasWidth, int atlasHeight)
+{
+    clear();
+    if (atlasWidth <= 0 || atlasHeight <= 0)
+    {
+        return;
+    }
+    SDL_Color white = { 255, 255, 255, 255 };
+    vertices.reserve(drawList.size() * 4);
+    indices.reserve(drawList.size() * 6);
+    for (const TileDraw& draw : drawList)
+    {
+        const SDL_Rect& clip = clips[draw.tile];
+        float u0 = clip.x / (float)atlasWidth;
+        float v0 = clip.y / (float)atlasHeight;
+        float u1 = (clip.x + clip.w) / (float)atlasWidth;
+        float v1 = (clip.y + clip.h) / (float)atlasHeight;
+        int first = vertices.size();
+        vertices.push_back({ { 0.0f, 0.0f }, white, { u0, v0 } });
+        vertices.push_back({ { 1.0f, 0.0f }, white, { u1, v0 } });
+        vertices.push_back({ { 0.0f, 1.0f }, white, { u0, v1 } });
+        vertices.push_back({ { 1.0f, 1.0f }, white, { u1, v1 } });
+        int quad[6] = { first, first + 1, first + 2, first + 2, first + 1, first + 3 };
+        indices.insert(indices.end(), quad, quad + 6);
+    }
+}
+
+inline void LTileGeometry::clear()
+{
+    vertices.clear();
+    indices.clear();
+    translated.clear();
+}
+
+inline bool LTileGeometry::render(SDL_Renderer* renderer, SDL_Texture* atlas, const std::vector<TileDraw>& drawList,
+                                  const std::vector<int>& rowStart, float init_x, float init_y, float tile_w, float tile_h,
+                                  int regionX, int regionY, int regionWidth, int regionHeight, int& drawCalls)
+{
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    if (atlas == NULL || vertices.size() != drawList.size() * 4)
+    {
+        return false;
+    }
+
+    //Tiles land on whole pixels, so neighbours share their edges without gaps or overlaps
+    translated.clear();
+    forEachTileInRegion(drawList, rowStart, init_x, init_y, tile_w, tile_h, regionX, regionY, regionWidth, regionHeight,
+                        [this, &drawList, tile_w, tile_h](const TileDraw& draw, float x, float y)
+                        {
+                            float left = std::floor(x);
+                            float top = std::floor(y);
+                            float width = std::floor(x + tile_w) - left;
+                            float height = std::floor(y + tile_h) - top;
+                            const SDL_Vertex* quad = &vertices[(&draw - drawList.data()) * 4];
+                            for (int k = 0; k < 4; k++)
+                            {
+                                SDL_Vertex vertex = quad[k];
+                                vertex.position.x = left + vertex.position.x * width;
+                                vertex.position.y = top + vertex.position.y * height;
+                                translated.push_back(vertex);
+                            }
+                        });
+    if (translated.empty())
+    {
+        return true;
+    }
+    if (SDL_RenderGeometry(renderer, atlas, translated.data(), translated.size(), indices.data(), translated.size() / 4 * 6) != 0)
+    {
+        return false;
+    }
+    drawCalls++;
+    return true;
+#else
+    return false;
+#endif
+}
+
+#endif